@@ -0,0 +1,609 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Run scripted client scenarios against a headless compositor and
+ * report per frame metrics as JSON.
+ */
+
+#include "testlib.h"
+#include "testlib-alloc.h"
+#include "testlib-layer-shell.h"
+
+#include "cursor.h"
+#include "desktop.h"
+#include "input-device.h"
+#include "output.h"
+#include "seat.h"
+#include "settings.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-client-protocol.h>
+
+#define BENCH_TIMEOUT 300
+
+#define N_TOPLEVELS       10
+#define N_TOPLEVEL_FRAMES 120
+#define N_DRAG_STEPS      120
+#define N_THUMBNAILS      50
+#define N_SWIPE_EVENTS    1000
+
+#define DRAG_HEIGHT 350
+#define DRAG_FOLDED 50
+
+
+typedef struct {
+  const char        *name;
+  PhocTestClientFunc func;
+
+  /* Measurement state, only touched on the server side */
+  gint64             start_us;
+  gint64             cpu_start_us;
+
+  /* Results */
+  GArray            *render_us;
+  GArray            *commit_us;
+  guint64            damage_area;
+  guint64            n_draws;
+  guint              n_scanned_out;
+  gint64             cpu_us;
+  guint              allocs;
+} BenchScenario;
+
+
+typedef struct {
+  struct wlr_touch  touch;
+  PhocInputDevice  *device;
+  guint32           time_msec;
+} BenchTouch;
+
+static BenchTouch touch_device;
+
+
+typedef enum {
+  BENCH_TOUCH_DOWN,
+  BENCH_TOUCH_MOTION,
+  BENCH_TOUCH_UP,
+} BenchTouchType;
+
+
+typedef struct {
+  BenchTouchType type;
+  double         x, y;      /* normalized to the output */
+  guint32        time_msec;
+} BenchTouchEvent;
+
+
+static PhocOutput *
+get_output (void)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output;
+
+  g_assert_false (wl_list_empty (&desktop->outputs));
+  output = wl_container_of (desktop->outputs.next, output, link);
+  g_assert_true (PHOC_IS_OUTPUT (output));
+
+  return output;
+}
+
+
+static gint64
+thread_cpu_time_us (void)
+{
+  struct timespec ts;
+
+  g_assert_cmpint (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts), ==, 0);
+
+  return ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+
+static gboolean
+bench_start_on_server (PhocServer *server, gpointer data)
+{
+  BenchScenario *scenario = data;
+
+  scenario->start_us = g_get_monotonic_time ();
+  scenario->cpu_start_us = thread_cpu_time_us ();
+  phoc_test_alloc_count_start ();
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_stop_on_server (PhocServer *server, gpointer data)
+{
+  BenchScenario *scenario = data;
+  PhocFrameTimings *timings;
+
+  scenario->allocs = phoc_test_alloc_count_stop ();
+  scenario->cpu_us = thread_cpu_time_us () - scenario->cpu_start_us;
+
+  timings = phoc_output_get_frame_timings (get_output ());
+  g_assert_nonnull (timings);
+
+  /* Oldest first. Frames outside of the ring buffer are lost. */
+  for (int i = phoc_frame_timings_get_n_items (timings) - 1; i >= 0; i--) {
+    const PhocFrameTiming *timing = phoc_frame_timings_get_item (timings, i);
+
+    if (timing->frame_us < scenario->start_us)
+      continue;
+
+    g_array_append_val (scenario->render_us, timing->render_us);
+    g_array_append_val (scenario->commit_us, timing->commit_us);
+    scenario->damage_area += timing->damage_area;
+    scenario->n_draws += timing->n_draws;
+    if (timing->scanned_out)
+      scenario->n_scanned_out++;
+  }
+
+  return TRUE;
+}
+
+
+static void
+bench_start (BenchScenario *scenario)
+{
+  phoc_test_client_run_in_server (bench_start_on_server, scenario);
+}
+
+
+static void
+bench_stop (BenchScenario *scenario)
+{
+  phoc_test_client_run_in_server (bench_stop_on_server, scenario);
+}
+
+/* Touch input */
+
+static PhocCursor *
+get_cursor (void)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  PhocSeat *seat = phoc_input_get_seat (input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+  return phoc_seat_get_cursor (seat);
+}
+
+
+static gboolean
+bench_touch_setup_on_server (PhocServer *server, gpointer data)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+
+  touch_device = (BenchTouch) { 0 };
+  wl_signal_init (&touch_device.touch.base.events.destroy);
+  touch_device.touch.base.type = WLR_INPUT_DEVICE_TOUCH;
+  touch_device.device = g_object_new (PHOC_TYPE_INPUT_DEVICE,
+                                     "seat", phoc_input_get_seat (input,
+                                                                  PHOC_CONFIG_DEFAULT_SEAT_NAME),
+                                     "device", &touch_device.touch.base,
+                                     NULL);
+  return TRUE;
+}
+
+
+static gboolean
+bench_touch_teardown_on_server (PhocServer *server, gpointer data)
+{
+  wl_signal_emit_mutable (&touch_device.touch.base.events.destroy, &touch_device.touch.base);
+  g_clear_object (&touch_device.device);
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_touch_on_server (PhocServer *server, gpointer data)
+{
+  BenchTouchEvent *event = data;
+  PhocCursor *cursor = get_cursor ();
+
+  switch (event->type) {
+  case BENCH_TOUCH_DOWN: {
+    struct wlr_touch_down_event down = {
+      .touch = &touch_device.touch,
+      .time_msec = event->time_msec,
+      .x = event->x,
+      .y = event->y,
+    };
+    phoc_cursor_handle_touch_down (cursor, &down);
+    break;
+  }
+  case BENCH_TOUCH_MOTION: {
+    struct wlr_touch_motion_event motion = {
+      .touch = &touch_device.touch,
+      .time_msec = event->time_msec,
+      .x = event->x,
+      .y = event->y,
+    };
+    phoc_cursor_handle_touch_motion (cursor, &motion);
+    break;
+  }
+  case BENCH_TOUCH_UP: {
+    struct wlr_touch_up_event up = {
+      .touch = &touch_device.touch,
+      .time_msec = event->time_msec,
+    };
+    phoc_cursor_handle_touch_up (cursor, &up);
+    break;
+  }
+  default:
+    g_assert_not_reached ();
+  }
+
+  wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+
+  return TRUE;
+}
+
+/*
+ * Feed a touch event and pace input like a touch screen reporting at
+ * @rate Hz would.
+ */
+static void
+bench_touch (BenchTouchType type, double x, double y, guint rate)
+{
+  BenchTouchEvent event = { .type = type, .x = x, .y = y };
+
+  touch_device.time_msec += 1000 / rate;
+  event.time_msec = touch_device.time_msec;
+  phoc_test_client_run_in_server (bench_touch_on_server, &event);
+
+  g_usleep (G_USEC_PER_SEC / rate);
+}
+
+/* Client helpers */
+
+static void
+frame_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_done,
+};
+
+
+static void
+update_toplevel_and_wait (PhocTestClientGlobals      *globals,
+                          PhocTestXdgToplevelSurface *xs,
+                          guint32                     color)
+{
+  struct wl_callback *callback;
+  gboolean done = FALSE;
+
+  callback = wl_surface_frame (xs->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, &done);
+  phoc_test_xdg_update_buffer (globals, xs, color);
+
+  while (!done)
+    g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+}
+
+/* Scenarios */
+
+static gboolean
+bench_toplevels_stacked (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchScenario *scenario = data;
+  PhocTestXdgToplevelSurface *toplevels[N_TOPLEVELS];
+  PhocTestXdgToplevelSurface *top;
+
+  for (int i = 0; i < N_TOPLEVELS; i++) {
+    g_autofree char *title = g_strdup_printf ("stacked-%d", i);
+
+    toplevels[i] = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, title,
+                                                           0xFF000000 | (i * 0x151515));
+  }
+  top = toplevels[N_TOPLEVELS - 1];
+
+  bench_start (scenario);
+  for (int i = 0; i < N_TOPLEVEL_FRAMES; i++)
+    update_toplevel_and_wait (globals, top, 0xFF000000 | (i % 2 ? 0xFF0000 : 0x00FF00));
+  bench_stop (scenario);
+
+  for (int i = 0; i < N_TOPLEVELS; i++)
+    phoc_test_xdg_toplevel_free (toplevels[i]);
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_layer_shell_drag (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchScenario *scenario = data;
+  struct zphoc_draggable_layer_surface_v1 *drag_surface;
+  PhocTestLayerSurface *ls;
+  double y, step;
+
+  ls = phoc_test_layer_surface_new (globals, 0, DRAG_HEIGHT, 0xFF00FF00,
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+                                    DRAG_FOLDED);
+  drag_surface = zphoc_layer_shell_effects_v1_get_draggable_layer_surface (
+    globals->layer_shell_effects, ls->layer_surface);
+  zphoc_draggable_layer_surface_v1_set_margins (drag_surface, -(DRAG_HEIGHT - DRAG_FOLDED), 0);
+  zphoc_draggable_layer_surface_v1_set_threshold (drag_surface, wl_fixed_from_double (0.5));
+  zphoc_draggable_layer_surface_v1_set_exclusive (drag_surface, DRAG_FOLDED);
+  zphoc_draggable_layer_surface_v1_set_state (drag_surface,
+                                              ZPHOC_DRAGGABLE_LAYER_SURFACE_V1_DRAG_END_STATE_FOLDED);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  phoc_test_client_run_in_server (bench_touch_setup_on_server, NULL);
+
+  /* Drag the folded surface open and closed again */
+  y = (DRAG_FOLDED / 2.0) / globals->output.height;
+  step = ((double)(DRAG_HEIGHT - DRAG_FOLDED) / globals->output.height) / (N_DRAG_STEPS / 2);
+
+  bench_start (scenario);
+  bench_touch (BENCH_TOUCH_DOWN, 0.5, y, 120);
+  for (int i = 0; i < N_DRAG_STEPS; i++) {
+    y += (i < N_DRAG_STEPS / 2) ? step : -step;
+    bench_touch (BENCH_TOUCH_MOTION, 0.5, y, 120);
+    wl_display_dispatch_pending (globals->display);
+  }
+  bench_touch (BENCH_TOUCH_UP, 0.5, y, 120);
+  wl_display_roundtrip (globals->display);
+  bench_stop (scenario);
+
+  phoc_test_client_run_in_server (bench_touch_teardown_on_server, NULL);
+
+  zphoc_draggable_layer_surface_v1_destroy (drag_surface);
+  phoc_test_layer_surface_free (ls);
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_thumbnail_burst (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchScenario *scenario = data;
+  PhocTestXdgToplevelSurface *toplevel;
+
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "thumbnails", 0xFF00FF00);
+  g_assert_nonnull (toplevel->foreign_toplevel);
+
+  bench_start (scenario);
+  for (int i = 0; i < N_THUMBNAILS; i++) {
+    struct zwlr_screencopy_frame_v1 *handle;
+    PhocTestScreencopyFrame thumbnail = { 0 };
+
+    /* New content each time so every thumbnail gets rendered */
+    phoc_test_xdg_update_buffer (globals, toplevel, 0xFF000000 | (i * 0x050505));
+
+    handle = phosh_private_get_thumbnail (globals->phosh, toplevel->foreign_toplevel->handle,
+                                          toplevel->width / 4, toplevel->height / 4);
+    phoc_test_client_capture_frame (globals, &thumbnail, handle);
+    zwlr_screencopy_frame_v1_destroy (handle);
+    phoc_test_buffer_free (&thumbnail.buffer);
+  }
+  bench_stop (scenario);
+
+  phoc_test_xdg_toplevel_free (toplevel);
+
+  return TRUE;
+}
+
+
+static gboolean
+bench_touch_swipe_storm (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchScenario *scenario = data;
+  PhocTestXdgToplevelSurface *toplevel;
+  double y = 0.5;
+
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "swipes", 0xFF00FF00);
+
+  phoc_test_client_run_in_server (bench_touch_setup_on_server, NULL);
+
+  bench_start (scenario);
+  bench_touch (BENCH_TOUCH_DOWN, 0.5, y, 240);
+  for (int i = 0; i < N_SWIPE_EVENTS; i++) {
+    /* Swipe up and down across the middle of the output */
+    y += ((i / 100) % 2) ? 0.004 : -0.004;
+    bench_touch (BENCH_TOUCH_MOTION, 0.5, y, 240);
+    wl_display_dispatch_pending (globals->display);
+  }
+  bench_touch (BENCH_TOUCH_UP, 0.5, y, 240);
+  wl_display_roundtrip (globals->display);
+  bench_stop (scenario);
+
+  phoc_test_client_run_in_server (bench_touch_teardown_on_server, NULL);
+
+  phoc_test_xdg_toplevel_free (toplevel);
+
+  return TRUE;
+}
+
+/* Reporting */
+
+static int
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 va = *(const gint64 *)a, vb = *(const gint64 *)b;
+
+  return (va > vb) - (va < vb);
+}
+
+
+static void
+append_double (GString *json, const char *key, double value)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (json, "\"%s\": %s", key, g_ascii_formatd (buf, sizeof (buf), "%.1f", value));
+}
+
+
+static void
+append_stats (GString *json, const char *key, GArray *values)
+{
+  gint64 sum = 0;
+  guint n = values->len;
+
+  g_array_sort (values, compare_gint64);
+  for (guint i = 0; i < n; i++)
+    sum += g_array_index (values, gint64, i);
+
+  g_string_append_printf (json, "\"%s\": { ", key);
+  append_double (json, "mean", n ? (double)sum / n : 0.0);
+  g_string_append (json, ", ");
+  g_string_append_printf (json, "\"p50\": %" G_GINT64_FORMAT ", ",
+                          n ? g_array_index (values, gint64, n / 2) : 0);
+  g_string_append_printf (json, "\"p95\": %" G_GINT64_FORMAT ", ",
+                          n ? g_array_index (values, gint64, MIN (n - 1, n * 95 / 100)) : 0);
+  g_string_append_printf (json, "\"max\": %" G_GINT64_FORMAT " }",
+                          n ? g_array_index (values, gint64, n - 1) : 0);
+}
+
+
+static void
+append_scenario (GString *json, BenchScenario *scenario)
+{
+  guint n_frames = scenario->render_us->len;
+
+  g_string_append_printf (json, "    {\n      \"name\": \"%s\",\n", scenario->name);
+  g_string_append_printf (json, "      \"frames\": %u,\n", n_frames);
+  g_string_append_printf (json, "      \"scanned_out\": %u,\n", scenario->n_scanned_out);
+  g_string_append_printf (json, "      \"cpu_us\": %" G_GINT64_FORMAT ",\n", scenario->cpu_us);
+  g_string_append (json, "      ");
+  append_double (json, "cpu_us_per_frame",
+                 n_frames ? (double)scenario->cpu_us / n_frames : 0.0);
+  g_string_append (json, ",\n      ");
+  append_stats (json, "render_us", scenario->render_us);
+  g_string_append (json, ",\n      ");
+  append_stats (json, "commit_latency_us", scenario->commit_us);
+  g_string_append (json, ",\n      ");
+  append_double (json, "damage_area_per_frame",
+                 n_frames ? (double)scenario->damage_area / n_frames : 0.0);
+  g_string_append (json, ",\n      ");
+  append_double (json, "draws_per_frame",
+                 n_frames ? (double)scenario->n_draws / n_frames : 0.0);
+  g_string_append (json, ",\n");
+  if (phoc_test_alloc_count_supported ()) {
+    g_string_append_printf (json, "      \"allocs\": %u,\n      ", scenario->allocs);
+    append_double (json, "allocs_per_frame",
+                   n_frames ? (double)scenario->allocs / n_frames : 0.0);
+  } else {
+    g_string_append (json, "      \"allocs\": null,\n      \"allocs_per_frame\": null");
+  }
+  g_string_append (json, "\n    }");
+}
+
+
+static void
+remove_runtime_dir (const char *path)
+{
+  g_autoptr (GDir) dir = g_dir_open (path, 0, NULL);
+  const char *name;
+
+  while (dir && (name = g_dir_read_name (dir))) {
+    g_autofree char *file = g_build_filename (path, name, NULL);
+
+    g_unlink (file);
+  }
+  g_rmdir (path);
+}
+
+
+static void
+run_scenario (BenchScenario *scenario)
+{
+  g_autoptr (GTestDBus) bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_autoptr (GError) err = NULL;
+  g_autofree char *runtime_dir = NULL;
+  PhocTestClientIface iface = {
+    .client_run = scenario->func,
+    .debug_flags = PHOC_SERVER_DEBUG_FLAG_FRAME_TIMINGS |
+                   PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  scenario->render_us = g_array_new (FALSE, FALSE, sizeof (gint64));
+  scenario->commit_us = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  g_test_dbus_up (bus);
+  runtime_dir = g_dir_make_tmp ("phoc-bench.XXXXXX", &err);
+  g_assert_no_error (err);
+  g_setenv ("XDG_RUNTIME_DIR", runtime_dir, TRUE);
+
+  phoc_test_client_run (BENCH_TIMEOUT, &iface, scenario);
+
+  remove_runtime_dir (runtime_dir);
+  g_test_dbus_down (bus);
+}
+
+
+static BenchScenario scenarios[] = {
+  { .name = "toplevels-stacked", .func = bench_toplevels_stacked },
+  { .name = "layer-shell-drag", .func = bench_layer_shell_drag },
+  { .name = "thumbnail-burst", .func = bench_thumbnail_burst },
+  { .name = "touch-swipe-storm", .func = bench_touch_swipe_storm },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GString) json = g_string_new ("{\n  \"scenarios\": [\n");
+  g_autofree char *output = NULL;
+  g_auto (GStrv) only = NULL;
+  gboolean first = TRUE;
+  const GOptionEntry options[] = {
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+     "Write results to FILE instead of stdout", "FILE"},
+    {"scenario", 's', 0, G_OPTION_ARG_STRING_ARRAY, &only,
+     "Only run the given scenario", "NAME"},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  opt_context = g_option_context_new ("- benchmark phoc");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return EXIT_FAILURE;
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    BenchScenario *scenario = &scenarios[i];
+
+    if (only && !g_strv_contains ((const char *const *)only, scenario->name))
+      continue;
+
+    run_scenario (scenario);
+
+    if (!first)
+      g_string_append (json, ",\n");
+    append_scenario (json, scenario);
+    first = FALSE;
+
+    g_clear_pointer (&scenario->render_us, g_array_unref);
+    g_clear_pointer (&scenario->commit_us, g_array_unref);
+  }
+  g_string_append (json, "\n  ]\n}\n");
+
+  if (output) {
+    if (!g_file_set_contents (output, json->str, json->len, &err)) {
+      g_printerr ("Failed to write %s: %s\n", output, err->message);
+      return EXIT_FAILURE;
+    }
+  } else {
+    g_print ("%s", json->str);
+  }
+
+  return EXIT_SUCCESS;
+}
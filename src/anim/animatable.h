@@ -16,17 +16,21 @@ G_DECLARE_INTERFACE (PhocAnimatable, phoc_animatable, PHOC, ANIMATABLE, GObject)
 /**
  * PhocFrameCallback:
  * @self: The animatable
- * @last_frame: Time of the last frame in us
+ * @frame_time: Predicted presentation time of the frame being built in us
  * @user_data: User data passed when registering the callback
  *
  * Callback type for adding a function to update animations. See
  * phoc_animatable_add_frame_callback().
  *
+ * Animations should be advanced based on @frame_time rather than the
+ * current time so they move steadily regardless of when the callback
+ * runs. @frame_time uses the same clock as g_get_monotonic_time ().
+ *
  * Returns: G_SOURCE_CONTINUE if the frame callback should continue to
  *  or G_SOURCE_REMOVE if the frame callback should be removed.
  */
 typedef gboolean (*PhocFrameCallback) (PhocAnimatable *self,
-                                       guint64         last_frame,
+                                       guint64         frame_time,
                                        gpointer        user_data);
 
 struct _PhocAnimatableInterface
@@ -41,6 +41,9 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+/* Enough for all fingers, more touch points get allocated */
+#define PHOC_CURSOR_TOUCH_POINT_POOL_SIZE 10
+
 typedef struct _PhocCursorPrivate {
   /* Would be good to store on the surface itself */
   PhocDraggableLayerSurface *drag_surface;
@@ -48,6 +51,8 @@ typedef struct _PhocCursorPrivate {
 
   /* The compositor tracked touch points */
   GHashTable       *touch_points;
+  PhocTouchPoint    touch_point_pool[PHOC_CURSOR_TOUCH_POINT_POOL_SIZE];
+  guint32           touch_point_pool_used;
 
   /* State of the animated view when cursor touches a screen edge */
   struct {
@@ -69,6 +74,7 @@ static void handle_pointer_button (struct wl_listener *listener, void *data);
 static void handle_pointer_axis (struct wl_listener *listener, void *data);
 static void handle_pointer_frame (struct wl_listener *listener, void *data);
 static void handle_touch_frame (struct wl_listener *listener, void *data);
+static void flush_touch_motion (PhocCursor *self);
 
 
 static void
@@ -454,11 +460,219 @@ send_touch_cancel (PhocSeat                  *seat,
 }
 
 
+static void
+touch_point_clear_route (PhocTouchPoint *touch_point)
+{
+  if (touch_point->route.surface == NULL)
+    return;
+
+  for (guint i = 0; i < touch_point->route.n_ancestors; i++) {
+    wl_list_remove (&touch_point->route.ancestors[i].commit.link);
+    wl_list_remove (&touch_point->route.ancestors[i].destroy.link);
+  }
+  touch_point->route.n_ancestors = 0;
+  wl_list_remove (&touch_point->route.root_unmap.link);
+  touch_point->route.surface = NULL;
+  touch_point->route.view = NULL;
+  touch_point->route.layer_surface = NULL;
+}
+
+
+static void
+handle_route_ancestor_commit (struct wl_listener *listener, void *data)
+{
+  PhocTouchRouteAncestor *ancestor = wl_container_of (listener, ancestor, commit);
+
+  /* Subsurface positions are applied on the parent's commit */
+  ancestor->touch_point->route.sub_valid = FALSE;
+}
+
+
+static void
+handle_route_ancestor_destroy (struct wl_listener *listener, void *data)
+{
+  PhocTouchRouteAncestor *ancestor = wl_container_of (listener, ancestor, destroy);
+
+  touch_point_clear_route (ancestor->touch_point);
+}
+
+
+static void
+handle_route_root_unmap (struct wl_listener *listener, void *data)
+{
+  PhocTouchPoint *touch_point = wl_container_of (listener, touch_point, route.root_unmap);
+
+  /* The view or layer surface might go away */
+  touch_point_clear_route (touch_point);
+}
+
+
+static gboolean
+touch_point_add_route_ancestor (PhocTouchPoint *touch_point, struct wlr_surface *surface)
+{
+  PhocTouchRouteAncestor *ancestor;
+
+  if (touch_point->route.n_ancestors == PHOC_TOUCH_ROUTE_MAX_ANCESTORS)
+    return FALSE;
+
+  ancestor = &touch_point->route.ancestors[touch_point->route.n_ancestors++];
+  ancestor->touch_point = touch_point;
+  ancestor->commit.notify = handle_route_ancestor_commit;
+  wl_signal_add (&surface->events.commit, &ancestor->commit);
+  ancestor->destroy.notify = handle_route_ancestor_destroy;
+  wl_signal_add (&surface->events.destroy, &ancestor->destroy);
+
+  return TRUE;
+}
+
+/*
+ * Resolve the view or layer surface @surface belongs to so touch
+ * motion doesn't need to look it up again. The result stays valid
+ * until the root surface gets unmapped or a parent gets destroyed.
+ */
+static void
+touch_point_update_route (PhocTouchPoint *touch_point, struct wlr_surface *surface)
+{
+  struct wlr_layer_surface_v1 *wlr_layer_surface;
+  struct wlr_subsurface *subsurface;
+  struct wlr_surface *root;
+  PhocLayerSurface *layer_surface = NULL;
+  PhocView *view = NULL;
+
+  touch_point_clear_route (touch_point);
+
+  root = wlr_surface_get_root_surface (surface);
+  wlr_layer_surface = wlr_layer_surface_v1_try_from_wlr_surface (root);
+  if (wlr_layer_surface)
+    layer_surface = wlr_layer_surface->data;
+  else
+    view = phoc_view_from_wlr_surface (root);
+
+  /* Popups and friends aren't cached */
+  if (layer_surface == NULL && view == NULL)
+    return;
+
+  touch_point->route.surface = surface;
+  touch_point->route.view = view;
+  touch_point->route.layer_surface = layer_surface;
+  touch_point->route.sub_valid = FALSE;
+
+  touch_point->route.root_unmap.notify = handle_route_root_unmap;
+  wl_signal_add (&root->events.unmap, &touch_point->route.root_unmap);
+
+  /*
+   * The subsurface offset changes whenever any parent commits, so
+   * track all of them. The last one is the root surface.
+   */
+  subsurface = wlr_subsurface_try_from_wlr_surface (surface);
+  if (subsurface == NULL)
+    touch_point_add_route_ancestor (touch_point, root);
+
+  for (; subsurface; subsurface = wlr_subsurface_try_from_wlr_surface (subsurface->parent)) {
+    if (!touch_point_add_route_ancestor (touch_point, subsurface->parent)) {
+      /* Nested too deeply, don't bother caching */
+      touch_point_clear_route (touch_point);
+      return;
+    }
+  }
+}
+
+/*
+ * Convert layout coordinates to surface local ones using the cached
+ * route. Returns %FALSE if there's no route for @surface.
+ */
+static gboolean
+touch_point_route_coords (PhocTouchPoint     *touch_point,
+                          struct wlr_surface *surface,
+                          double              lx,
+                          double              ly,
+                          double             *sx,
+                          double             *sy)
+{
+  if (touch_point->route.surface == NULL || touch_point->route.surface != surface)
+    return FALSE;
+
+  if (touch_point->route.layer_surface) {
+    PhocLayerSurface *layer_surface = touch_point->route.layer_surface;
+    PhocOutput *output = phoc_layer_surface_get_output (layer_surface);
+
+    if (output == NULL)
+      return FALSE;
+
+    *sx = lx - layer_surface->geo.x - output->lx;
+    *sy = ly - layer_surface->geo.y - output->ly;
+  } else {
+    PhocView *view = touch_point->route.view;
+    float scale = phoc_view_get_scale (view);
+
+    *sx = lx / scale - view->box.x;
+    *sy = ly / scale - view->box.y;
+  }
+
+  if (!touch_point->route.sub_valid) {
+    struct wlr_surface *sub = surface;
+
+    touch_point->route.sub_x = touch_point->route.sub_y = 0;
+    while (sub) {
+      struct wlr_subsurface *subsurface = wlr_subsurface_try_from_wlr_surface (sub);
+      if (subsurface == NULL)
+        break;
+
+      touch_point->route.sub_x += subsurface->current.x;
+      touch_point->route.sub_y += subsurface->current.y;
+      sub = subsurface->parent;
+    }
+    touch_point->route.sub_valid = TRUE;
+  }
+
+  *sx -= touch_point->route.sub_x;
+  *sy -= touch_point->route.sub_y;
+
+  return TRUE;
+}
+
+
+static PhocTouchPoint *
+touch_point_new (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  for (int i = 0; i < PHOC_CURSOR_TOUCH_POINT_POOL_SIZE; i++) {
+    if (!(priv->touch_point_pool_used & (1 << i))) {
+      priv->touch_point_pool_used |= (1 << i);
+      priv->touch_point_pool[i] = (PhocTouchPoint) { 0 };
+      return &priv->touch_point_pool[i];
+    }
+  }
+
+  return g_new0 (PhocTouchPoint, 1);
+}
+
+
+static void
+touch_point_free (PhocCursor *self, PhocTouchPoint *touch_point)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+
+  touch_point_clear_route (touch_point);
+
+  for (int i = 0; i < PHOC_CURSOR_TOUCH_POINT_POOL_SIZE; i++) {
+    if (touch_point == &priv->touch_point_pool[i]) {
+      priv->touch_point_pool_used &= ~(1 << i);
+      return;
+    }
+  }
+
+  g_free (touch_point);
+}
+
+
 static PhocTouchPoint *
 phoc_cursor_add_touch_point (PhocCursor *self, struct wlr_touch_down_event *event)
 {
-  PhocTouchPoint *touch_point = g_new0 (PhocTouchPoint, 1);
+  PhocTouchPoint *touch_point = touch_point_new (self);
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocTouchPoint *old;
   double lx, ly;
 
   wlr_cursor_absolute_to_layout_coords (self->cursor, &event->touch->base,
@@ -467,11 +681,12 @@ phoc_cursor_add_touch_point (PhocCursor *self, struct wlr_touch_down_event *even
   touch_point->lx = lx;
   touch_point->ly = ly;
 
-  if (!g_hash_table_insert (priv->touch_points,
-                            GINT_TO_POINTER (event->touch_id),
-                            touch_point)) {
+  old = g_hash_table_lookup (priv->touch_points, GINT_TO_POINTER (event->touch_id));
+  if (old) {
     g_critical ("Touch point %d already tracked, ignoring", event->touch_id);
+    touch_point_free (self, old);
   }
+  g_hash_table_insert (priv->touch_points, GINT_TO_POINTER (event->touch_id), touch_point);
 
   return touch_point;
 }
@@ -502,9 +717,16 @@ static void
 phoc_cursor_remove_touch_point (PhocCursor *self, int touch_id)
 {
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocTouchPoint *touch_point;
 
-  if (!g_hash_table_remove (priv->touch_points, GINT_TO_POINTER (touch_id)))
+  touch_point = g_hash_table_lookup (priv->touch_points, GINT_TO_POINTER (touch_id));
+  if (touch_point == NULL) {
     g_critical ("Touch point %d didn't exist", touch_id);
+    return;
+  }
+
+  g_hash_table_remove (priv->touch_points, GINT_TO_POINTER (touch_id));
+  touch_point_free (self, touch_point);
 }
 
 
@@ -567,17 +789,20 @@ handle_gestures_for_event_at (PhocCursor   *self,
                               gpointer      wlr_event,
                               gsize         size)
 {
-  g_autoptr (PhocEvent) event = phoc_event_new (type, wlr_event, size);
   GSList *gestures = phoc_cursor_get_gestures (self);
+  PhocEvent event;
 
   if (gestures == NULL)
     return;
 
+  /* Gestures copy what they need, so avoid a heap allocation per event */
+  phoc_event_init (&event, type, wlr_event, size);
+
   for (GSList *elem = gestures; elem; elem = elem->next) {
     PhocGesture *gesture = PHOC_GESTURE (elem->data);
 
     g_assert (PHOC_IS_GESTURE (gesture));
-    phoc_gesture_handle_event (gesture, event, lx, ly);
+    phoc_gesture_handle_event (gesture, &event, lx, ly);
   }
 }
 
@@ -834,6 +1059,14 @@ phoc_cursor_finalize (GObject *object)
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
 
   phoc_cursor_clear_view_state_change (self);
+  if (priv->touch_points) {
+    GHashTableIter iter;
+    PhocTouchPoint *touch_point;
+
+    g_hash_table_iter_init (&iter, priv->touch_points);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&touch_point))
+      touch_point_free (self, touch_point);
+  }
   g_clear_pointer (&priv->touch_points, g_hash_table_destroy);
   g_clear_pointer (&priv->gestures, free_gestures);
 
@@ -1027,10 +1260,8 @@ phoc_cursor_init (PhocCursor *self)
   self->cursor = wlr_cursor_create ();
   self->default_xcursor = PHOC_XCURSOR_DEFAULT;
 
-  priv->touch_points = g_hash_table_new_full (g_direct_hash,
-                                              g_direct_equal,
-                                              NULL,
-                                              g_free);
+  /* Values are owned by the touch point pool */
+  priv->touch_points = g_hash_table_new (g_direct_hash, g_direct_equal);
   /*
    * Drag gesture starting at the current cursor position
    */
@@ -1380,6 +1611,9 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
   PhocTouchPoint *touch_point;
   double lx, ly;
 
+  /* Keep the order of events */
+  flush_touch_motion (self);
+
   touch_point = phoc_cursor_add_touch_point (self, event);
   lx = touch_point->lx;
   ly = touch_point->ly;
@@ -1400,6 +1634,7 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
     struct wlr_surface *root = wlr_surface_get_root_surface (surface);
 
     send_touch_down (seat, surface, event, sx, sy);
+    touch_point_update_route (touch_point, surface);
 
     if (view)
       phoc_seat_set_focus_view (seat, view);
@@ -1436,14 +1671,17 @@ void
 phoc_cursor_handle_touch_up (PhocCursor                *self,
                              struct wlr_touch_up_event *event)
 {
-  struct wlr_touch_point *point =
-    wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
+  struct wlr_touch_point *point;
   PhocTouchPoint *touch_point;
   PhocCursorPrivate *priv;
 
   g_assert (PHOC_IS_CURSOR (self));
   priv = phoc_cursor_get_instance_private (self);
 
+  /* Keep the order of events */
+  flush_touch_motion (self);
+
+  point = wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
   touch_point = phoc_cursor_get_touch_point (self, event->touch_id);
 
   /* Don't process unknown touch points */
@@ -1473,22 +1711,38 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
 }
 
 
-void
-phoc_cursor_handle_touch_motion (PhocCursor                    *self,
-                                 struct wlr_touch_motion_event *event)
+/*
+ * Feed the buffered motion samples of @touch_point to the gestures so
+ * velocity estimation sees every sample, not just the latest one.
+ */
+static void
+feed_touch_samples (PhocCursor *self, PhocTouchPoint *touch_point)
+{
+  for (guint i = 0; i < touch_point->n_samples; i++) {
+    PhocTouchSample *sample = &touch_point->samples[i];
+
+    handle_gestures_for_event_at (self, sample->lx, sample->ly, PHOC_EVENT_TOUCH_UPDATE,
+                                  &sample->motion, sizeof (sample->motion));
+  }
+}
+
+
+static void
+deliver_touch_motion (PhocCursor *self, PhocTouchPoint *touch_point)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  struct wlr_touch_motion_event event;
   struct wlr_touch_point *point;
-  PhocTouchPoint *touch_point;
   double lx, ly;
 
-  touch_point = phoc_cursor_update_touch_point (self, event);
-  g_return_if_fail (touch_point);
+  event = touch_point->samples[touch_point->n_samples - 1].motion;
   lx = touch_point->lx;
   ly = touch_point->ly;
-  handle_gestures_for_event_at (self, lx, ly, PHOC_EVENT_TOUCH_UPDATE, event, sizeof (*event));
 
-  point = wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
+  feed_touch_samples (self, touch_point);
+  touch_point->n_samples = 0;
+
+  point = wlr_seat_touch_get_point (self->seat->seat, event.touch_id);
   /* If the gesture got canceled don't notify any clients */
   if (!point)
     return;
@@ -1502,79 +1756,25 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
 
   // TODO: test with input regions
   if (surface) {
-    bool found = false;
-    float scale = 1.0;
-
-    struct wlr_surface *root = wlr_surface_get_root_surface (surface);
-    struct wlr_layer_surface_v1 *wlr_layer_surface = wlr_layer_surface_v1_try_from_wlr_surface (root);
-    if (wlr_layer_surface) {
+    if (touch_point->route.surface != surface)
+      touch_point_update_route (touch_point, surface);
 
-      struct wlr_box output_box;
-      wlr_output_layout_get_box (desktop->layout, output->wlr_output, &output_box);
-
-      PhocLayerSurface *layer_surface;
-      wl_list_for_each_reverse (layer_surface, &output->layer_surfaces, link)
-      {
-        if (layer_surface->layer != wlr_layer_surface->current.layer)
-          continue;
-
-        if (layer_surface->layer_surface->surface == root) {
-          sx = lx - layer_surface->geo.x - output_box.x;
-          sy = ly - layer_surface->geo.y - output_box.y;
-          found = true;
-          break;
-        }
-      }
-      // try the overlay layer as well since the on-screen keyboard might have been elevated there
-      wl_list_for_each_reverse (layer_surface, &output->layer_surfaces, link)
-      {
-        if (layer_surface->layer != ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY)
-          continue;
-
-        if (layer_surface->layer_surface->surface == root) {
-          sx = lx - layer_surface->geo.x - output_box.x;
-          sy = ly - layer_surface->geo.y - output_box.y;
-          found = true;
-          break;
-        }
-      }
-    } else {
-      PhocView *view = phoc_view_from_wlr_surface (root);
-      if (view) {
-        scale = phoc_view_get_scale (view);
-        sx = lx / scale - view->box.x;
-        sy = ly / scale - view->box.y;
-        found = true;
-      } else {
-        // FIXME: buggy fallback, but at least handles xdg_popups for now...
-        surface = phoc_desktop_wlr_surface_at (desktop, lx, ly, &sx, &sy, NULL);
-      }
-    }
-
-    if (found) {
-      struct wlr_surface *sub = surface;
-      while (sub) {
-        struct wlr_subsurface *subsurface = wlr_subsurface_try_from_wlr_surface (sub);
-        if (subsurface == NULL)
-          break;
-
-        sx -= subsurface->current.x;
-        sy -= subsurface->current.y;
-        sub = subsurface->parent;
-      }
+    if (!touch_point_route_coords (touch_point, surface, lx, ly, &sx, &sy)) {
+      // FIXME: buggy fallback, but at least handles xdg_popups for now...
+      surface = phoc_desktop_wlr_surface_at (desktop, lx, ly, &sx, &sy, NULL);
     }
 
-    if (phoc_seat_allow_input (self->seat, surface->resource))
-      send_touch_motion (self->seat, surface, event, sx, sy);
+    if (surface && phoc_seat_allow_input (self->seat, surface->resource))
+      send_touch_motion (self->seat, surface, &event, sx, sy);
   }
 
-  if (event->touch_id == self->seat->touch_id) {
+  if (event.touch_id == self->seat->touch_id) {
     self->seat->touch_x = lx;
     self->seat->touch_y = ly;
 
     if (self->mode != PHOC_CURSOR_PASSTHROUGH) {
       wlr_cursor_warp (self->cursor, NULL, lx, ly);
-      phoc_cursor_update_position (self, event->time_msec);
+      phoc_cursor_update_position (self, event.time_msec);
     }
 
     if (self->seat->drag_icon != NULL)
@@ -1582,6 +1782,56 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
   }
 }
 
+/*
+ * Deliver the queued motion events to gestures and clients. Gestures
+ * get all buffered samples, clients only the latest position of each
+ * touch point.
+ */
+static void
+flush_touch_motion (PhocCursor *self)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocTouchPoint *touch_point;
+  GHashTableIter iter;
+
+  g_hash_table_iter_init (&iter, priv->touch_points);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&touch_point)) {
+    if (touch_point->n_samples)
+      deliver_touch_motion (self, touch_point);
+  }
+}
+
+/**
+ * phoc_cursor_handle_touch_motion:
+ * @self: The cursor
+ * @event: The motion event
+ *
+ * Queue a touch motion event. Motion events are buffered per touch
+ * point and delivered on the next touch frame. Gestures see every
+ * sample while clients only get the latest position.
+ */
+void
+phoc_cursor_handle_touch_motion (PhocCursor                    *self,
+                                 struct wlr_touch_motion_event *event)
+{
+  PhocTouchPoint *touch_point;
+  PhocTouchSample *sample;
+
+  touch_point = phoc_cursor_update_touch_point (self, event);
+  g_return_if_fail (touch_point);
+
+  /* Out of room, let gestures catch up but keep the client side coalesced */
+  if (touch_point->n_samples == PHOC_TOUCH_POINT_MAX_SAMPLES) {
+    feed_touch_samples (self, touch_point);
+    touch_point->n_samples = 0;
+  }
+
+  sample = &touch_point->samples[touch_point->n_samples++];
+  sample->motion = *event;
+  sample->lx = touch_point->lx;
+  sample->ly = touch_point->ly;
+}
+
 
 static void
 handle_touch_frame (struct wl_listener *listener, void *data)
@@ -1589,6 +1839,7 @@ handle_touch_frame (struct wl_listener *listener, void *data)
   PhocCursor *self = PHOC_CURSOR (wl_container_of (listener, self, touch_frame));
   struct wlr_seat *wlr_seat = self->seat->seat;
 
+  flush_touch_motion (self);
   wlr_seat_touch_notify_frame(wlr_seat);
 
   // make sure to always send frame events when necessary even when bypassing seat grabs
@@ -33,17 +33,54 @@ typedef enum {
 
 typedef struct _PhocSeatView PhocSeatView;
 
+/* Motion samples of a touch point buffered within a touch frame */
+#define PHOC_TOUCH_POINT_MAX_SAMPLES 8
+
+typedef struct PhocTouchSample {
+  struct wlr_touch_motion_event motion;
+  double                        lx, ly;
+} PhocTouchSample;
+
+/* Parent surfaces of a touch point's surface tracked for the route cache */
+#define PHOC_TOUCH_ROUTE_MAX_ANCESTORS 4
+
+typedef struct PhocTouchPoint PhocTouchPoint;
+
+typedef struct PhocTouchRouteAncestor {
+  PhocTouchPoint     *touch_point;
+  struct wl_listener  commit;
+  struct wl_listener  destroy;
+} PhocTouchRouteAncestor;
+
 /**
  * PhocTouchPoint:
  *
  * A touch point tracked compositor side.
  */
-typedef struct PhocTouchPoint {
+struct PhocTouchPoint {
   int   touch_id;
 
   double lx;
   double ly;
-} PhocTouchPoint;
+
+  /* Motion that wasn't delivered yet, oldest first */
+  guint                         n_samples;
+  PhocTouchSample               samples[PHOC_TOUCH_POINT_MAX_SAMPLES];
+
+  /* Resolved target of the touch point, valid while surface != NULL */
+  struct {
+    struct wlr_surface    *surface;
+    PhocView              *view;
+    PhocLayerSurface      *layer_surface;
+    /* Accumulated offset of surface relative to its root */
+    gboolean               sub_valid;
+    double                 sub_x, sub_y;
+    /* Parents up to and including the root surface, closest first */
+    guint                  n_ancestors;
+    PhocTouchRouteAncestor ancestors[PHOC_TOUCH_ROUTE_MAX_ANCESTORS];
+    struct wl_listener     root_unmap;
+  } route;
+};
 
 /* TODO: we keep the struct public due to the list links and
    notifiers but we should avoid other member access */
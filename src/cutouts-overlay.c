@@ -153,71 +153,143 @@ phoc_cutouts_overlay_new (const char * const *compatibles)
 }
 
 
-struct wlr_texture *
-phoc_cutouts_overlay_get_cutouts_texture (PhocCutoutsOverlay *self, PhocOutput *output)
+static cairo_t *
+tile_begin (const struct wlr_box *box)
+{
+  g_autoptr (cairo_surface_t) surface = NULL;
+  cairo_t *cr;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, box->width, box->height);
+  cr = cairo_create (surface);
+  /* Allow to draw in panel coordinates */
+  cairo_translate (cr, -box->x, -box->y);
+  cairo_set_line_width (cr, 5.0);
+  cairo_set_source_rgba (cr, 0.5f, 0.0f, 0.5f, 0.5f);
+
+  return cr;
+}
+
+
+static PhocCutoutsOverlayTile *
+tile_end (cairo_t *cr, const struct wlr_box *box)
 {
-  int width, height, radius, stride;
-  GListModel *cutouts;
-  unsigned char *data;
   PhocServer *server = phoc_server_get_default ();
   PhocRenderer *renderer = phoc_server_get_renderer (server);
+  cairo_surface_t *surface = cairo_get_target (cr);
+  PhocCutoutsOverlayTile *tile;
   struct wlr_texture *texture;
-  g_autoptr (cairo_surface_t) surface = NULL;
+
+  cairo_surface_flush (surface);
+  texture = wlr_texture_from_pixels (phoc_renderer_get_wlr_renderer (renderer),
+                                     DRM_FORMAT_ARGB8888,
+                                     cairo_image_surface_get_stride (surface),
+                                     box->width,
+                                     box->height,
+                                     cairo_image_surface_get_data (surface));
+  if (texture == NULL) {
+    g_warning ("Failed to create cutouts texture");
+    return NULL;
+  }
+
+  tile = g_new0 (PhocCutoutsOverlayTile, 1);
+  tile->texture = texture;
+  tile->box = *box;
+
+  return tile;
+}
+
+
+static void
+add_corner_tile (GPtrArray *tiles, int x, int y, int radius, double angle)
+{
+  struct wlr_box box = { x, y, radius, radius };
   g_autoptr (cairo_t) cr = NULL;
+  PhocCutoutsOverlayTile *tile;
+  /* The corner of the panel */
+  int corner_x = angle == 0 || angle == 1.5 * M_PI ? x + radius : x;
+  int corner_y = angle == 0 || angle == 0.5 * M_PI ? y + radius : y;
+  /* The center of the arc */
+  int center_x = corner_x == x ? x + radius : x;
+  int center_y = corner_y == y ? y + radius : y;
+
+  cr = tile_begin (&box);
+  cairo_move_to (cr, corner_x, corner_y);
+  cairo_arc (cr, center_x, center_y, radius, angle, angle + 0.5 * M_PI);
+  cairo_close_path (cr);
+  cairo_fill (cr);
+
+  tile = tile_end (cr, &box);
+  if (tile)
+    g_ptr_array_add (tiles, tile);
+}
+
+/**
+ * phoc_cutouts_overlay_get_tiles:
+ * @self: The cutouts overlay
+ * @output: The output the overlay is for
+ *
+ * Rasterize the display's cutouts and rounded corners. Each cutout
+ * and corner gets its own small tile so only the parts of the panel
+ * that are covered need to be rendered.
+ *
+ * Returns:(transfer container)(element-type PhocCutoutsOverlayTile)(nullable): The tiles
+ */
+GPtrArray *
+phoc_cutouts_overlay_get_tiles (PhocCutoutsOverlay *self, PhocOutput *output)
+{
+  int width, height, radius;
+  GListModel *cutouts;
+  g_autoptr (GPtrArray) tiles = NULL;
 
   g_return_val_if_fail (PHOC_IS_CUTOUTS_OVERLAY (self), NULL);
 
   if (self->panel == NULL)
     return NULL;
 
+  tiles = g_ptr_array_new_with_free_func ((GDestroyNotify)phoc_cutouts_overlay_tile_free);
+
   width = gm_display_panel_get_x_res (self->panel);
   height = gm_display_panel_get_y_res (self->panel);
   radius = gm_display_panel_get_border_radius (self->panel);
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-  cr = cairo_create (surface);
-  cairo_set_line_width (cr, 5.0);
-  cairo_set_source_rgba (cr, 0.5f, 0.0f, 0.5f, 0.5f);
-
   cutouts = gm_display_panel_get_cutouts (self->panel);
   for (int i = 0; i < g_list_model_get_n_items (cutouts); i++) {
     g_autoptr (GmCutout) cutout = g_list_model_get_item (cutouts, i);
     const GmRect *bounds = gm_cutout_get_bounds (cutout);
+    struct wlr_box box = { bounds->x, bounds->y, bounds->width, bounds->height };
+    g_autoptr (cairo_t) cr = NULL;
+    PhocCutoutsOverlayTile *tile;
+
+    if (wlr_box_empty (&box))
+      continue;
 
+    cr = tile_begin (&box);
     cairo_rectangle (cr, bounds->x, bounds->y, bounds->width, bounds->height);
     cairo_fill (cr);
-  }
 
-  /* top left */
-  cairo_move_to (cr, 0, 0);
-  cairo_arc (cr, radius, radius, radius, M_PI, 1.5 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
-
-  /* top right */
-  cairo_move_to (cr, width, 0);
-  cairo_arc (cr, width - radius, radius, radius, 1.5 * M_PI, 2 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
-
-  /* bottom right */
-  cairo_move_to (cr, width, height);
-  cairo_arc (cr, width - radius, height - radius, radius, 0, 0.5 * M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
+    tile = tile_end (cr, &box);
+    if (tile)
+      g_ptr_array_add (tiles, tile);
+  }
 
-  /* bottom left */
-  cairo_move_to (cr, 0, height);
-  cairo_arc (cr, radius, height - radius, radius, 0.5 * M_PI, M_PI);
-  cairo_close_path (cr);
-  cairo_fill (cr);
+  if (radius > 0) {
+    /* top left */
+    add_corner_tile (tiles, 0, 0, radius, M_PI);
+    /* top right */
+    add_corner_tile (tiles, width - radius, 0, radius, 1.5 * M_PI);
+    /* bottom right */
+    add_corner_tile (tiles, width - radius, height - radius, radius, 0);
+    /* bottom left */
+    add_corner_tile (tiles, 0, height - radius, radius, 0.5 * M_PI);
+  }
 
-  cairo_surface_flush (surface);
-  data = cairo_image_surface_get_data (surface);
-  stride = cairo_image_surface_get_stride (surface);
+  return g_steal_pointer (&tiles);
+}
 
-  texture = wlr_texture_from_pixels (phoc_renderer_get_wlr_renderer (renderer),
-                                     DRM_FORMAT_ARGB8888, stride, width, height, data);
 
-  return texture;
+void
+phoc_cutouts_overlay_tile_free (PhocCutoutsOverlayTile *tile)
+{
+  g_clear_pointer (&tile->texture, wlr_texture_destroy);
+  g_free (tile);
 }
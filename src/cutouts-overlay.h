@@ -9,6 +9,7 @@
 #include "output.h"
 
 #include <glib-object.h>
+#include <wlr/util/box.h>
 
 G_BEGIN_DECLS
 
@@ -16,8 +17,21 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (PhocCutoutsOverlay, phoc_cutouts_overlay, PHOC, CUTOUTS_OVERLAY, GObject)
 
-PhocCutoutsOverlay *phoc_cutouts_overlay_new                 (const char * const *compatibles);
-struct wlr_texture *phoc_cutouts_overlay_get_cutouts_texture (PhocCutoutsOverlay *self,
-                                                              PhocOutput         *output);
+/**
+ * PhocCutoutsOverlayTile:
+ * @texture: The tile's texture
+ * @box: The tile's position and size in panel coordinates
+ *
+ * A part of the [class@CutoutsOverlay].
+ */
+typedef struct _PhocCutoutsOverlayTile {
+  struct wlr_texture *texture;
+  struct wlr_box      box;
+} PhocCutoutsOverlayTile;
+
+PhocCutoutsOverlay *phoc_cutouts_overlay_new       (const char * const *compatibles);
+GPtrArray          *phoc_cutouts_overlay_get_tiles (PhocCutoutsOverlay *self,
+                                                    PhocOutput         *output);
+void                phoc_cutouts_overlay_tile_free (PhocCutoutsOverlayTile *tile);
 
 G_END_DECLS
@@ -157,6 +157,9 @@ view_at (PhocView *view, double lx, double ly, struct wlr_surface **surface, dou
   double view_sx = lx / phoc_view_get_scale (view) - view->box.x;
   double view_sy = ly / phoc_view_get_scale (view) - view->box.y;
 
+  if (!phoc_view_may_have_surface_at (view, view_sx, view_sy))
+    return false;
+
   _surface = phoc_view_get_wlr_surface_at (view, view_sx, view_sy, &_sx, &_sy);
   if (_surface != NULL) {
     if (sx)
@@ -867,6 +870,7 @@ phoc_desktop_finalize (GObject *object)
 
   g_hash_table_remove_all (self->input_output_map);
   g_hash_table_unref (self->input_output_map);
+  g_clear_pointer (&self->output_config_tests, g_hash_table_destroy);
 
   g_clear_object (&priv->interface_settings);
   g_clear_object (&priv->settings);
@@ -913,6 +917,7 @@ phoc_desktop_init (PhocDesktop *self)
                                                   g_str_equal,
                                                   g_free,
                                                   NULL);
+  self->output_config_tests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 
@@ -1249,11 +1254,15 @@ void
 phoc_desktop_notify_activity (PhocDesktop *self, PhocSeat *seat)
 {
   PhocDesktopPrivate *priv;
+  PhocOutput *output;
 
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
   wlr_idle_notifier_v1_notify_activity (priv->idle_notifier_v1, seat->seat);
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_notify_activity (output);
 }
 
 gboolean
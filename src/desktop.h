@@ -97,6 +97,7 @@ struct _PhocDesktop {
 
   gboolean maximize, scale_to_fit;
   GHashTable *input_output_map;
+  GHashTable *output_config_tests; /* serialized config → test result */
 };
 
 PhocDesktop *phoc_desktop_new (void);
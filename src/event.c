@@ -48,6 +48,29 @@ G_DEFINE_BOXED_TYPE (PhocEventSequence, phoc_event_sequence,
                      phoc_event_sequence_copy,
                      phoc_event_sequence_free);
 
+/**
+ * phoc_event_init:
+ * @event: The event to initialize
+ * @type: The type of event.
+ * @wlr_event: (nullable): The wlroots event
+ * @size: The size of the wlroots event
+ *
+ * Initializes a caller allocated #PhocEvent, e.g. one on the stack, so
+ * events can be passed on without hitting the heap.
+ */
+void
+phoc_event_init (PhocEvent *event, PhocEventType type, const gpointer wlr_event, gsize size)
+{
+  g_assert (wlr_event == NULL || size >= sizeof (struct wlr_touch_cancel_event));
+  g_assert (size <= sizeof (*event) - G_STRUCT_OFFSET (PhocEvent, button_press));
+
+  memset (event, 0, sizeof (*event));
+  event->type = type;
+
+  if (wlr_event)
+    memcpy (&event->button_press, wlr_event, size);
+}
+
 /**
  * phoc_event_new:
  * @type: The type of event.
@@ -59,20 +82,12 @@ G_DEFINE_BOXED_TYPE (PhocEventSequence, phoc_event_sequence,
 PhocEvent *
 phoc_event_new (PhocEventType type, gpointer wlr_event, gsize size)
 {
-  PhocEvent *new_event;
   PhocEventPrivate *priv;
 
-  g_assert (wlr_event == NULL || size >= sizeof (struct wlr_touch_cancel_event));
-
   priv = g_new0 (PhocEventPrivate, 1);
+  phoc_event_init (&priv->base, type, wlr_event, size);
 
-  new_event = (PhocEvent *) priv;
-  new_event->type = type;
-
-  if (wlr_event)
-    memcpy (&new_event->button_press, wlr_event, size);
-
-  return new_event;
+  return &priv->base;
 }
 
 /**
@@ -142,6 +142,10 @@ struct  _PhocEvent {
 
 GType                       phoc_event_get_type                      (void) G_GNUC_CONST;
 GType                       phoc_event_sequence_get_type             (void) G_GNUC_CONST;
+void                        phoc_event_init                          (PhocEvent       *event,
+                                                                      PhocEventType    type,
+                                                                      const gpointer   wlr_event,
+                                                                      gsize            size);
 PhocEvent                  *phoc_event_new                           (PhocEventType    type,
                                                                       const gpointer   wlr_event,
                                                                       gsize            size);
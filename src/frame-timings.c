@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-frame-timings"
+
+#include "phoc-config.h"
+
+#include "frame-timings.h"
+
+/**
+ * PhocFrameTimings:
+ *
+ * A fixed size ring buffer of [struct@FrameTiming]s. Once full the
+ * oldest entries get overwritten so recording never allocates.
+ */
+struct _PhocFrameTimings {
+  PhocFrameTiming *items;
+  guint            size;
+  guint            head;  /* next slot to write */
+  guint            n_items;
+};
+
+/**
+ * phoc_frame_timings_new:
+ * @size: The maximum number of timings to keep
+ *
+ * Returns: (transfer full): A new ring buffer for frame timings
+ */
+PhocFrameTimings *
+phoc_frame_timings_new (guint size)
+{
+  PhocFrameTimings *self = g_new0 (PhocFrameTimings, 1);
+
+  g_assert (size > 0);
+
+  self->items = g_new0 (PhocFrameTiming, size);
+  self->size = size;
+
+  return self;
+}
+
+
+void
+phoc_frame_timings_free (PhocFrameTimings *self)
+{
+  g_free (self->items);
+  g_free (self);
+}
+
+/**
+ * phoc_frame_timings_add:
+ * @self: The frame timings
+ * @timing: The timing to record
+ *
+ * Record the timing of a frame, replacing the oldest one if the ring
+ * buffer is full.
+ */
+void
+phoc_frame_timings_add (PhocFrameTimings *self, const PhocFrameTiming *timing)
+{
+  self->items[self->head] = *timing;
+  self->head = (self->head + 1) % self->size;
+  self->n_items = MIN (self->n_items + 1, self->size);
+}
+
+/**
+ * phoc_frame_timings_get_n_items:
+ * @self: The frame timings
+ *
+ * Returns: The number of recorded timings
+ */
+guint
+phoc_frame_timings_get_n_items (PhocFrameTimings *self)
+{
+  return self->n_items;
+}
+
+/**
+ * phoc_frame_timings_get_item:
+ * @self: The frame timings
+ * @index: The index of the timing, `0` being the most recent one
+ *
+ * Returns: (transfer none): The timing
+ */
+const PhocFrameTiming *
+phoc_frame_timings_get_item (PhocFrameTimings *self, guint index)
+{
+  g_assert (index < self->n_items);
+
+  return &self->items[(self->head + self->size - 1 - index) % self->size];
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocFrameTiming:
+ * @frame_us: Monotonic time when the output's frame signal fired
+ * @render_us: Time spent rendering the output including submitting the render pass
+ * @commit_us: Time from the frame signal until the commit finished
+ * @damage_area: Damaged area in buffer pixels
+ * @n_draws: Number of textures and rectangles drawn
+ * @scanned_out: Whether a surface was scanned out directly
+ * @committed: Whether the output commit succeeded
+ *
+ * Timing information about a single frame on an output.
+ */
+typedef struct _PhocFrameTiming {
+  gint64   frame_us;
+  gint64   render_us;
+  gint64   commit_us;
+  guint64  damage_area;
+  guint    n_draws;
+  gboolean scanned_out;
+  gboolean committed;
+} PhocFrameTiming;
+
+typedef struct _PhocFrameTimings PhocFrameTimings;
+
+PhocFrameTimings      *phoc_frame_timings_new         (guint size);
+void                   phoc_frame_timings_free        (PhocFrameTimings *self);
+void                   phoc_frame_timings_add         (PhocFrameTimings      *self,
+                                                       const PhocFrameTiming *timing);
+guint                  phoc_frame_timings_get_n_items (PhocFrameTimings *self);
+const PhocFrameTiming *phoc_frame_timings_get_item    (PhocFrameTimings *self, guint index);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocFrameTimings, phoc_frame_timings_free)
+
+G_END_DECLS
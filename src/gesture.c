@@ -40,7 +40,7 @@ typedef struct _PointData PointData;
 
 
 struct _PointData {
-  PhocEvent *event;
+  PhocEvent  event;
 
   double     lx;
   double     ly;
@@ -51,8 +51,13 @@ struct _PointData {
 
   guint      press_handled : 1;
   guint      state : 2;
+  guint      pooled : 1;
+  guint      in_use : 1;
 };
 
+/* Enough for all fingers, more points get allocated */
+#define PHOC_GESTURE_POINT_POOL_SIZE 10
+
 /**
  * PhocGesture:
  *
@@ -67,6 +72,8 @@ typedef struct _PhocGesturePrivate {
   guint              n_points;
   guint              recognized : 1;
   guint              touchpad : 1;
+
+  PointData          point_pool[PHOC_GESTURE_POINT_POOL_SIZE];
 } PhocGesturePrivate;
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (PhocGesture, phoc_gesture, G_TYPE_OBJECT)
@@ -152,19 +159,19 @@ phoc_gesture_get_n_touchpad_points (PhocGesture *self,
 
   if (only_active &&
       (data->state == PHOC_EVENT_SEQUENCE_DENIED ||
-       data->event->type == PHOC_EVENT_TOUCHPAD_SWIPE_END ||
-       data->event->type == PHOC_EVENT_TOUCHPAD_PINCH_END))
+       data->event.type == PHOC_EVENT_TOUCHPAD_SWIPE_END ||
+       data->event.type == PHOC_EVENT_TOUCHPAD_PINCH_END))
     return 0;
 
-  switch (data->event->type) {
+  switch (data->event.type) {
   case PHOC_EVENT_TOUCHPAD_SWIPE_BEGIN:
-    return data->event->touchpad_swipe_begin.fingers;
+    return data->event.touchpad_swipe_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_SWIPE_UPDATE:
-    return data->event->touchpad_swipe_begin.fingers;
+    return data->event.touchpad_swipe_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_PINCH_BEGIN:
-    return data->event->touchpad_pinch_begin.fingers;
+    return data->event.touchpad_pinch_begin.fingers;
   case PHOC_EVENT_TOUCHPAD_PINCH_UPDATE:
-    return data->event->touchpad_pinch_begin.fingers;
+    return data->event.touchpad_pinch_begin.fingers;
   default:
     return 0;
   }
@@ -209,8 +216,8 @@ phoc_gesture_get_n_touch_points (PhocGesture *self,
   while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &data)) {
     if (only_active &&
         (data->state == PHOC_EVENT_SEQUENCE_DENIED ||
-         data->event->type == PHOC_EVENT_TOUCH_END ||
-         data->event->type == PHOC_EVENT_BUTTON_RELEASE))
+         data->event.type == PHOC_EVENT_TOUCH_END ||
+         data->event.type == PHOC_EVENT_BUTTON_RELEASE))
       continue;
 
     n_points++;
@@ -316,14 +323,11 @@ phoc_gesture_check_recognized (PhocGesture       *self,
 static void
 update_touchpad_deltas (PointData *data)
 {
-  PhocEvent *event = data->event;
+  PhocEvent *event = &data->event;
   PhocTouchpadGesturePhase phase;
   double dx;
   double dy;
 
-  if (!event)
-    return;
-
   if (!phoc_event_is_touchpad_gesture (event))
     return;
 
@@ -338,6 +342,25 @@ update_touchpad_deltas (PointData *data)
 }
 
 
+/* Points come from a preallocated pool so event handling doesn't allocate */
+static PointData *
+point_data_new (PhocGesture *self)
+{
+  PhocGesturePrivate *priv = phoc_gesture_get_instance_private (self);
+
+  for (int i = 0; i < PHOC_GESTURE_POINT_POOL_SIZE; i++) {
+    PointData *data = &priv->point_pool[i];
+
+    if (!data->in_use) {
+      *data = (PointData) { .pooled = TRUE, .in_use = TRUE };
+      return data;
+    }
+  }
+
+  return g_new0 (PointData, 1);
+}
+
+
 static gboolean
 phoc_gesture_update_point (PhocGesture     *self,
                            const PhocEvent *event,
@@ -387,14 +410,11 @@ phoc_gesture_update_point (PhocGesture     *self,
       priv->touchpad = touchpad;
     }
 
-    data = g_new0 (PointData, 1);
+    data = point_data_new (self);
     g_hash_table_insert (priv->points, sequence, data);
   }
 
-  if (data->event)
-    phoc_event_free (data->event);
-
-  data->event = phoc_event_copy (event);
+  data->event = *event;
   update_touchpad_deltas (data);
   data->lx = lx + data->accum_dx;
   data->ly = ly + data->accum_dy;
@@ -490,7 +510,7 @@ phoc_gesture_cancel_sequence (PhocGesture       *self,
     return FALSE;
 
   g_signal_emit (self, signals[CANCEL], 0, sequence);
-  phoc_gesture_remove_point (self, data->event);
+  phoc_gesture_remove_point (self, &data->event);
   phoc_gesture_check_recognized (self, sequence);
 
   return TRUE;
@@ -719,8 +739,10 @@ free_point_data (gpointer data)
 {
   PointData *point = data;
 
-  g_clear_pointer (&point->event, phoc_event_free);
-  g_free (point);
+  if (point->pooled)
+    point->in_use = FALSE;
+  else
+    g_free (point);
 }
 
 
@@ -974,8 +996,8 @@ phoc_gesture_get_sequences (PhocGesture *self)
   while (g_hash_table_iter_next (&iter, (gpointer *) &sequence, (gpointer *) &data)) {
     if (data->state == PHOC_EVENT_SEQUENCE_DENIED)
       continue;
-    if (data->event->type == PHOC_EVENT_TOUCH_END ||
-        data->event->type == PHOC_EVENT_BUTTON_RELEASE)
+    if (data->event.type == PHOC_EVENT_TOUCH_END ||
+        data->event.type == PHOC_EVENT_BUTTON_RELEASE)
       continue;
 
     sequences = g_list_prepend (sequences, sequence);
@@ -1031,7 +1053,7 @@ phoc_gesture_get_last_event (PhocGesture *self, PhocEventSequence *sequence)
   if (!data)
     return NULL;
 
-  return data->event;
+  return &data->event;
 }
 
 
@@ -1092,7 +1114,7 @@ phoc_gesture_get_last_update_time (PhocGesture       *self,
     return FALSE;
 
   if (evtime)
-    *evtime = phoc_event_get_time (data->event);
+    *evtime = phoc_event_get_time (&data->event);
 
   return TRUE;
 }
@@ -43,6 +43,21 @@ typedef struct
 } PhocKeybinding;
 
 
+/**
+ * PhocKeybindingsEntry:
+ *
+ * What a key combination is bound to. A combination can be both a
+ * compositor keybinding and an accelerator grabbed by a client.
+ */
+typedef struct
+{
+  PhocKeybinding     *binding;
+
+  gpointer            grab_owner;
+  guint               grab_action_id;
+} PhocKeybindingsEntry;
+
+
 typedef struct _PhocKeybindings
 {
   GObject parent;
@@ -50,6 +65,9 @@ typedef struct _PhocKeybindings
   GSList *bindings;
   GSettings *settings;
   GSettings *mutter_settings;
+
+  /* (keysym, modifiers) → PhocKeybindingsEntry */
+  GHashTable *index;
 } PhocKeybindings;
 
 G_DEFINE_TYPE (PhocKeybindings, phoc_keybindings, G_TYPE_OBJECT);
@@ -456,30 +474,75 @@ phoc_keybinding_free (PhocKeybinding *keybinding)
 
 
 static gboolean
-key_combo_eq (const PhocKeyCombo *sym1, const PhocKeyCombo *sym2)
+keybinding_by_name (const PhocKeybinding *keybinding, const gchar *name)
 {
-  return (sym1->modifiers == sym2->modifiers && sym1->keysym == sym2->keysym);
+  return g_strcmp0 (keybinding->name, name);
 }
 
 
-static gboolean
-keybinding_by_name (const PhocKeybinding *keybinding, const gchar *name)
+static inline gint64
+key_combo_to_key (const PhocKeyCombo *combo)
 {
-  return g_strcmp0 (keybinding->name, name);
+  return ((gint64)combo->modifiers << 32) | combo->keysym;
+}
+
+
+static PhocKeybindingsEntry *
+lookup_entry (PhocKeybindings *self, const PhocKeyCombo *combo)
+{
+  gint64 key = key_combo_to_key (combo);
+
+  return g_hash_table_lookup (self->index, &key);
+}
+
+
+static PhocKeybindingsEntry *
+ensure_entry (PhocKeybindings *self, const PhocKeyCombo *combo)
+{
+  PhocKeybindingsEntry *entry = lookup_entry (self, combo);
+  gint64 *key;
+
+  if (entry)
+    return entry;
+
+  key = g_new (gint64, 1);
+  *key = key_combo_to_key (combo);
+  entry = g_new0 (PhocKeybindingsEntry, 1);
+  g_hash_table_insert (self->index, key, entry);
+
+  return entry;
 }
 
 
 static gboolean
-keybinding_by_key_combo (const PhocKeybinding *keybinding, const PhocKeyCombo *combo)
+drop_binding (gpointer key, gpointer value, gpointer user_data)
 {
-  GSList *elem = keybinding->combos;
+  PhocKeybindingsEntry *entry = value;
+
+  entry->binding = NULL;
+  return entry->grab_owner == NULL;
+}
 
-  while (elem) {
-    if (key_combo_eq (elem->data, combo))
-      return FALSE;
-    elem = elem->next;
+/*
+ * Rebuild the compositor keybinding part of the index. Client grabs
+ * are kept. If a combo is used by several keybindings the first one
+ * wins.
+ */
+static void
+rebuild_index (PhocKeybindings *self)
+{
+  g_hash_table_foreach_remove (self->index, drop_binding, NULL);
+
+  for (GSList *l = self->bindings; l; l = l->next) {
+    PhocKeybinding *keybinding = l->data;
+
+    for (GSList *c = keybinding->combos; c; c = c->next) {
+      PhocKeybindingsEntry *entry = ensure_entry (self, c->data);
+
+      if (entry->binding == NULL)
+        entry->binding = keybinding;
+    }
   }
-  return TRUE;
 }
 
 
@@ -519,6 +582,8 @@ on_keybinding_setting_changed (PhocKeybindings *self,
     if (combo)
       keybinding->combos = g_slist_append (keybinding->combos, combo);
   }
+
+  rebuild_index (self);
 }
 
 
@@ -561,6 +626,7 @@ phoc_keybindings_dispose (GObject *object)
 
   g_slist_free_full (self->bindings, (GDestroyNotify)phoc_keybinding_free);
   self->bindings = NULL;
+  rebuild_index (self);
 
   G_OBJECT_CLASS (phoc_keybindings_parent_class)->dispose (object);
 }
@@ -573,6 +639,7 @@ phoc_keybindings_finalize (GObject *object)
 
   g_clear_object (&self->settings);
   g_clear_object (&self->mutter_settings);
+  g_clear_pointer (&self->index, g_hash_table_destroy);
 
   G_OBJECT_CLASS (phoc_keybindings_parent_class)->finalize (object);
 }
@@ -655,6 +722,7 @@ static void
 phoc_keybindings_init (PhocKeybindings *self)
 {
   self->bindings = NULL;
+  self->index = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
 }
 
 
@@ -683,8 +751,7 @@ phoc_keybindings_handle_pressed (PhocKeybindings *self,
                                  guint32          length,
                                  PhocSeat        *seat)
 {
-  PhocKeybinding *keybinding;
-  GSList *elem;
+  PhocKeybindingsEntry *entry;
   PhocKeyCombo combo;
 
   if (length != 1)
@@ -693,15 +760,99 @@ phoc_keybindings_handle_pressed (PhocKeybindings *self,
   combo.keysym = pressed_keysyms[0];
   combo.modifiers = modifiers;
 
-  elem = g_slist_find_custom (self->bindings,
-                              &combo,
-                              (GCompareFunc)keybinding_by_key_combo);
-  if (!elem)
+  entry = lookup_entry (self, &combo);
+  if (!entry || !entry->binding)
     return FALSE;
 
-  g_return_val_if_fail (elem->data, FALSE);
-  keybinding = elem->data;
+  (*entry->binding->func) (seat, entry->binding->param);
+  return TRUE;
+}
 
-  (*keybinding->func) (seat, keybinding->param);
+/**
+ * phoc_keybindings_grab_accelerator:
+ * @self: The keybindings
+ * @combo: The key combination to grab
+ * @owner: The grab's owner
+ * @action_id: The action id to report when the accelerator gets activated
+ *
+ * Let a client grab an accelerator. Only one owner can grab a given
+ * key combination at a time.
+ *
+ * Returns: %TRUE if the accelerator was grabbed, %FALSE if it's
+ *   already grabbed.
+ */
+gboolean
+phoc_keybindings_grab_accelerator (PhocKeybindings    *self,
+                                   const PhocKeyCombo *combo,
+                                   gpointer            owner,
+                                   guint               action_id)
+{
+  PhocKeybindingsEntry *entry;
+
+  g_assert (PHOC_IS_KEYBINDINGS (self));
+  g_assert (owner);
+
+  entry = ensure_entry (self, combo);
+  if (entry->grab_owner)
+    return FALSE;
+
+  entry->grab_owner = owner;
+  entry->grab_action_id = action_id;
   return TRUE;
 }
+
+/**
+ * phoc_keybindings_ungrab_accelerator:
+ * @self: The keybindings
+ * @combo: The key combination to ungrab
+ * @owner: The grab's owner
+ *
+ * Release an accelerator grabbed via [method@Keybindings.grab_accelerator].
+ */
+void
+phoc_keybindings_ungrab_accelerator (PhocKeybindings    *self,
+                                     const PhocKeyCombo *combo,
+                                     gpointer            owner)
+{
+  PhocKeybindingsEntry *entry;
+  gint64 key = key_combo_to_key (combo);
+
+  g_assert (PHOC_IS_KEYBINDINGS (self));
+
+  entry = g_hash_table_lookup (self->index, &key);
+  g_return_if_fail (entry && entry->grab_owner == owner);
+
+  entry->grab_owner = NULL;
+  entry->grab_action_id = 0;
+  if (entry->binding == NULL)
+    g_hash_table_remove (self->index, &key);
+}
+
+/**
+ * phoc_keybindings_lookup_grab:
+ * @self: The keybindings
+ * @combo: The key combination to look up
+ * @action_id: (out)(optional): The grab's action id
+ *
+ * Look up the client grab for the given key combination.
+ *
+ * Returns: (transfer none)(nullable): The owner of the grab
+ */
+gpointer
+phoc_keybindings_lookup_grab (PhocKeybindings    *self,
+                              const PhocKeyCombo *combo,
+                              guint              *action_id)
+{
+  PhocKeybindingsEntry *entry;
+
+  g_assert (PHOC_IS_KEYBINDINGS (self));
+
+  entry = lookup_entry (self, combo);
+  if (!entry || !entry->grab_owner)
+    return NULL;
+
+  if (action_id)
+    *action_id = entry->grab_action_id;
+
+  return entry->grab_owner;
+}
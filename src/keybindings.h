@@ -36,5 +36,15 @@ gboolean         phoc_keybindings_handle_pressed (PhocKeybindings *self,
                                                   xkb_keysym_t *pressed_keysyms,
                                                   guint32 length,
                                                   PhocSeat *seat);
+gboolean         phoc_keybindings_grab_accelerator   (PhocKeybindings    *self,
+                                                      const PhocKeyCombo *combo,
+                                                      gpointer            owner,
+                                                      guint               action_id);
+void             phoc_keybindings_ungrab_accelerator (PhocKeybindings    *self,
+                                                      const PhocKeyCombo *combo,
+                                                      gpointer            owner);
+gpointer         phoc_keybindings_lookup_grab        (PhocKeybindings    *self,
+                                                      const PhocKeyCombo *combo,
+                                                      guint              *action_id);
 PhocKeyCombo    *phoc_parse_accelerator (const gchar * accelerator);
 G_END_DECLS
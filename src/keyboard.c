@@ -471,19 +471,18 @@ phoc_keyboard_handle_modifiers (PhocKeyboard *self)
 static void
 set_fallback_keymap (PhocKeyboard *self)
 {
-  struct xkb_context *context;
+  PhocKeymapCache *cache = phoc_server_get_keymap_cache (phoc_server_get_default ());
   PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
   struct wlr_input_device *device = phoc_input_device_get_device (input_device);
   struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device (device);
+  struct xkb_keymap *keymap;
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL)
+  keymap = phoc_keymap_cache_lookup (cache, &(struct xkb_rule_names) { 0 });
+  if (keymap == NULL)
     return;
 
   xkb_keymap_unref (self->keymap);
-  self->keymap = xkb_keymap_new_from_names (context, NULL,
-                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
+  self->keymap = keymap;
 
   wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
 }
@@ -492,8 +491,8 @@ set_fallback_keymap (PhocKeyboard *self)
 static void
 set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
 {
+  PhocKeymapCache *cache = phoc_server_get_keymap_cache (phoc_server_get_default ());
   struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context = NULL;
   struct xkb_keymap *keymap = NULL;
   PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
   struct wlr_input_device *device = phoc_input_device_get_device (input_device);
@@ -505,21 +504,16 @@ set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, c
   rules.variant = variant;
   rules.options = options;
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-    g_warning ("Cannot create XKB context");
-    goto out;
-  }
-
-  keymap = xkb_map_new_from_names (context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  keymap = phoc_keymap_cache_lookup (cache, &rules);
   if (keymap == NULL)
     g_warning ("Cannot create XKB keymap");
 
- out:
-  if (context)
-    xkb_context_unref (context);
-
   if (keymap) {
+    /* Same keymap, nothing to do */
+    if (keymap == self->keymap) {
+      xkb_keymap_unref (keymap);
+      return;
+    }
     xkb_keymap_unref (self->keymap);
     self->keymap = keymap;
   } else if (self->keymap == NULL) {
@@ -531,6 +525,31 @@ set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, c
 }
 
 
+/* Compile the keymaps of all other input sources so switching is fast */
+static void
+prefetch_keymaps (PhocKeyboard *self, GVariantIter *iter, const char *options)
+{
+  PhocKeymapCache *cache = phoc_server_get_keymap_cache (phoc_server_get_default ());
+  const char *type, *id;
+
+  while (g_variant_iter_next (iter, "(&s&s)", &type, &id)) {
+    const char *layout = NULL, *variant = NULL;
+
+    if (g_strcmp0 (type, "xkb"))
+      continue;
+
+    if (!gnome_xkb_info_get_layout_info (self->xkbinfo, id, NULL, NULL, &layout, &variant))
+      continue;
+
+    phoc_keymap_cache_prefetch (cache, &(struct xkb_rule_names) {
+        .layout = layout,
+        .variant = variant,
+        .options = options,
+      });
+  }
+}
+
+
 static void
 on_input_setting_changed (PhocKeyboard *self,
                           const gchar  *key,
@@ -584,6 +603,7 @@ on_input_setting_changed (PhocKeyboard *self,
   g_debug ("Switching to layout %s %s", layout, variant);
 
   set_xkb_keymap (self, layout, variant, xkb_options_string);
+  prefetch_keymaps (self, &iter, xkb_options_string);
 }
 
 
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-keymap-cache"
+
+#include "phoc-config.h"
+
+#include "keymap-cache.h"
+
+#include <gio/gio.h>
+
+/**
+ * PhocKeymapCache:
+ *
+ * A cache of compiled XKB keymaps keyed by layout, variant and
+ * options shared by all keyboards.
+ *
+ * Compiling a keymap means parsing the XKB rules and files from disk
+ * which is slow. Keymaps that will likely be needed soon (like all
+ * configured input sources) can be compiled ahead of time on a
+ * worker thread via [method@KeymapCache.prefetch] so switching to
+ * them doesn't block the main loop.
+ */
+struct _PhocKeymapCache {
+  GObject       parent;
+
+  GHashTable   *keymaps; /* key → struct xkb_keymap */
+  GHashTable   *pending; /* keys being compiled */
+  GCancellable *cancel;
+};
+G_DEFINE_TYPE (PhocKeymapCache, phoc_keymap_cache, G_TYPE_OBJECT)
+
+
+typedef struct {
+  char *layout;
+  char *variant;
+  char *options;
+} PhocKeymapCacheNames;
+
+
+static void
+phoc_keymap_cache_names_free (PhocKeymapCacheNames *names)
+{
+  g_free (names->layout);
+  g_free (names->variant);
+  g_free (names->options);
+  g_free (names);
+}
+
+
+static char *
+names_to_key (const struct xkb_rule_names *names)
+{
+  return g_strdup_printf ("%s:%s:%s",
+                          names->layout ?: "",
+                          names->variant ?: "",
+                          names->options ?: "");
+}
+
+/* Runs in the main thread and in the worker threads */
+static struct xkb_keymap *
+compile_keymap (const char *layout, const char *variant, const char *options)
+{
+  struct xkb_rule_names rules = {
+    .layout = layout,
+    .variant = variant,
+    .options = options,
+  };
+  struct xkb_context *context;
+  struct xkb_keymap *keymap;
+
+  /* Contexts aren't thread safe so use a new one for each keymap */
+  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (context == NULL) {
+    g_warning ("Cannot create XKB context");
+    return NULL;
+  }
+
+  keymap = xkb_keymap_new_from_names (context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  xkb_context_unref (context);
+
+  return keymap;
+}
+
+
+static void
+compile_keymap_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  PhocKeymapCacheNames *names = task_data;
+  struct xkb_keymap *keymap;
+
+  keymap = compile_keymap (names->layout, names->variant, names->options);
+  if (keymap == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Cannot create XKB keymap for '%s' '%s'",
+                             names->layout, names->variant);
+    return;
+  }
+
+  g_task_return_pointer (task, keymap, (GDestroyNotify)xkb_keymap_unref);
+}
+
+
+static void
+on_keymap_compiled (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (source_object);
+  g_autofree char *key = user_data;
+  g_autoptr (GError) err = NULL;
+  struct xkb_keymap *keymap;
+
+  g_hash_table_remove (self->pending, key);
+
+  keymap = g_task_propagate_pointer (G_TASK (res), &err);
+  if (keymap == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("%s", err->message);
+    return;
+  }
+
+  /* Compiled synchronously in the meantime */
+  if (g_hash_table_contains (self->keymaps, key)) {
+    xkb_keymap_unref (keymap);
+    return;
+  }
+
+  g_debug ("Prefetched keymap '%s'", key);
+  g_hash_table_insert (self->keymaps, g_steal_pointer (&key), keymap);
+}
+
+
+static void
+phoc_keymap_cache_dispose (GObject *object)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (object);
+
+  g_cancellable_cancel (self->cancel);
+  g_clear_object (&self->cancel);
+
+  G_OBJECT_CLASS (phoc_keymap_cache_parent_class)->dispose (object);
+}
+
+
+static void
+phoc_keymap_cache_finalize (GObject *object)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (object);
+
+  g_clear_pointer (&self->keymaps, g_hash_table_destroy);
+  g_clear_pointer (&self->pending, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_keymap_cache_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_keymap_cache_class_init (PhocKeymapCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = phoc_keymap_cache_dispose;
+  object_class->finalize = phoc_keymap_cache_finalize;
+}
+
+
+static void
+phoc_keymap_cache_init (PhocKeymapCache *self)
+{
+  self->keymaps = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify)xkb_keymap_unref);
+  self->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->cancel = g_cancellable_new ();
+}
+
+
+PhocKeymapCache *
+phoc_keymap_cache_new (void)
+{
+  return g_object_new (PHOC_TYPE_KEYMAP_CACHE, NULL);
+}
+
+/**
+ * phoc_keymap_cache_lookup:
+ * @self: The keymap cache
+ * @names: The rule names to look up
+ *
+ * Look up the keymap for the given rule names. If it's not cached yet
+ * it's compiled right away.
+ *
+ * Returns: (transfer full)(nullable): The keymap
+ */
+struct xkb_keymap *
+phoc_keymap_cache_lookup (PhocKeymapCache *self, const struct xkb_rule_names *names)
+{
+  g_autofree char *key = NULL;
+  struct xkb_keymap *keymap;
+
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  key = names_to_key (names);
+  keymap = g_hash_table_lookup (self->keymaps, key);
+  if (keymap)
+    return xkb_keymap_ref (keymap);
+
+  g_debug ("Compiling keymap '%s'", key);
+  keymap = compile_keymap (names->layout, names->variant, names->options);
+  if (keymap == NULL)
+    return NULL;
+
+  g_hash_table_insert (self->keymaps, g_steal_pointer (&key), keymap);
+  return xkb_keymap_ref (keymap);
+}
+
+/**
+ * phoc_keymap_cache_prefetch:
+ * @self: The keymap cache
+ * @names: The rule names to prefetch
+ *
+ * Compile the keymap for the given rule names on a worker thread so
+ * a later [method@KeymapCache.lookup] finds it in the cache.
+ */
+void
+phoc_keymap_cache_prefetch (PhocKeymapCache *self, const struct xkb_rule_names *names)
+{
+  g_autoptr (GTask) task = NULL;
+  PhocKeymapCacheNames *task_names;
+  g_autofree char *key = NULL;
+
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  key = names_to_key (names);
+  if (g_hash_table_contains (self->keymaps, key) || g_hash_table_contains (self->pending, key))
+    return;
+
+  task_names = g_new0 (PhocKeymapCacheNames, 1);
+  task_names->layout = g_strdup (names->layout);
+  task_names->variant = g_strdup (names->variant);
+  task_names->options = g_strdup (names->options);
+
+  g_hash_table_add (self->pending, g_strdup (key));
+
+  task = g_task_new (self, self->cancel, on_keymap_compiled, g_steal_pointer (&key));
+  g_task_set_source_tag (task, phoc_keymap_cache_prefetch);
+  g_task_set_task_data (task, task_names, (GDestroyNotify)phoc_keymap_cache_names_free);
+  g_task_run_in_thread (task, compile_keymap_thread);
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <xkbcommon/xkbcommon.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_KEYMAP_CACHE (phoc_keymap_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocKeymapCache, phoc_keymap_cache, PHOC, KEYMAP_CACHE, GObject)
+
+PhocKeymapCache   *phoc_keymap_cache_new      (void);
+struct xkb_keymap *phoc_keymap_cache_lookup   (PhocKeymapCache            *self,
+                                               const struct xkb_rule_names *names);
+void               phoc_keymap_cache_prefetch (PhocKeymapCache            *self,
+                                               const struct xkb_rule_names *names);
+
+G_END_DECLS
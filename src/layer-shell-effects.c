@@ -73,6 +73,7 @@ struct _PhocDraggableLayerSurface {
     guint    anim_id;
     float    anim_t;
     int32_t  anim_duration;
+    gint64   anim_start_us;
     int32_t  anim_start;
     int32_t  anim_end;
     PhocAnimDir anim_dir;
@@ -1034,6 +1035,24 @@ apply_margin (PhocDraggableLayerSurface *drag_surface, double margin)
 }
 
 
+/*
+ * Arrange the dragged surface's layer after its margin changed and
+ * damage it and its popups at their new position. Callers damage the
+ * old position before changing the margin so the output only repaints
+ * the union of both. Since the effective exclusive zone doesn't change
+ * while dragging views only get rearranged when the usable area really
+ * changed.
+ */
+static void
+arrange_and_damage (PhocDraggableLayerSurface *drag_surface, PhocOutput *output)
+{
+  PhocLayerSurface *layer_surface = drag_surface->layer_surface;
+
+  phoc_layer_shell_arrange_layer (output, layer_surface->layer);
+  phoc_layer_surface_damage (layer_surface);
+}
+
+
 static void
 apply_state (PhocDraggableLayerSurface *drag_surface, PhocDraggableSurfaceState state)
 {
@@ -1050,7 +1069,7 @@ apply_state (PhocDraggableLayerSurface *drag_surface, PhocDraggableSurfaceState
 
 
 static gboolean
-on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpointer user_data)
+on_output_frame_callback (PhocAnimatable *animatable, guint64 frame_time, gpointer user_data)
 
 {
   PhocDraggableLayerSurface *drag_surface = user_data;
@@ -1112,9 +1131,11 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
     apply_state (drag_surface, PHOC_DRAGGABLE_SURFACE_STATE_NONE);
     drag_surface->drag.anim_id = 0;
   } else {
-    gint64 now = g_get_monotonic_time ();
+    if (drag_surface->drag.anim_start_us == 0)
+      drag_surface->drag.anim_start_us = frame_time;
 
-    drag_surface->drag.anim_t += ((float)(now - last_frame)) / drag_surface->drag.anim_duration;
+    drag_surface->drag.anim_t = ((float)(frame_time - drag_surface->drag.anim_start_us)) /
+      drag_surface->drag.anim_duration;
     if (drag_surface->drag.anim_t > 1.0)
       drag_surface->drag.anim_t = 1.0;
 
@@ -1131,10 +1152,9 @@ on_output_frame_callback (PhocAnimatable *animatable, guint64 last_frame, gpoint
     zphoc_draggable_layer_surface_v1_send_dragged (drag_surface->resource, (int32_t)margin);
   }
 
+  phoc_layer_surface_damage (layer_surface);
   apply_margin (drag_surface, margin);
-  phoc_layer_shell_arrange (output);
-  /* FIXME: way too much damage */
-  phoc_output_damage_whole (output);
+  arrange_and_damage (drag_surface, output);
 
   return done ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
 }
@@ -1175,6 +1195,7 @@ phoc_draggable_layer_surface_slide (PhocDraggableLayerSurface *drag_surface, Pho
   }
 
   drag_surface->drag.anim_t = 0;
+  drag_surface->drag.anim_start_us = 0;
   drag_surface->drag.anim_start = margin;
   drag_surface->drag.anim_dir = anim_dir;
   drag_surface->drag.anim_end = (anim_dir == ANIM_DIR_OUT) ?
@@ -1283,6 +1304,7 @@ accept_drag (PhocDraggableLayerSurface *drag_surface,
   if (margin <= drag_surface->current.folded)
     margin = drag_surface->current.folded;
 
+  phoc_layer_surface_damage (drag_surface->layer_surface);
   *target = margin;
   wlr_layer_surface->current.exclusive_zone = -margin + drag_surface->current.exclusive;
 
@@ -1293,10 +1315,7 @@ accept_drag (PhocDraggableLayerSurface *drag_surface,
   wlr_layer_surface->pending.exclusive_zone = wlr_layer_surface->current.exclusive_zone;
 
   zphoc_draggable_layer_surface_v1_send_dragged (drag_surface->resource, margin);
-  phoc_layer_shell_arrange (output);
-
-  /* FIXME: way too much damage */
-  phoc_output_damage_whole (output);
+  arrange_and_damage (drag_surface, output);
 
   apply_state (drag_surface, PHOC_DRAGGABLE_SURFACE_STATE_DRAGGING);
 }
@@ -1551,7 +1570,7 @@ phoc_draggable_layer_surface_drag_end (PhocDraggableLayerSurface *drag_surface,
       ANIM_DIR_IN : ANIM_DIR_OUT;
   }
 
-  phoc_layer_shell_arrange (output);
+  phoc_layer_shell_arrange_layer (output, drag_surface->layer_surface->layer);
   drag_surface->drag.pending_accept = 0;
   drag_surface->drag.pending_reject = 0;
 
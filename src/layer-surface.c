@@ -188,17 +188,32 @@ phoc_layer_surface_new (struct wlr_layer_surface_v1 *layer_surface)
 }
 
 
+typedef struct {
+  PhocOutput *output;
+  int         ox, oy;
+} PhocLayerSurfaceDamageData;
+
+
+static void
+damage_popup_iterator (struct wlr_surface *surface, int sx, int sy, void *user_data)
+{
+  PhocLayerSurfaceDamageData *data = user_data;
+
+  phoc_output_damage_whole_surface (data->output, surface, data->ox + sx, data->oy + sy);
+}
+
 /**
  * phoc_layer_surface_damage:
  * @self: The layer surface to damage
  *
- * Damage a layer surface
+ * Damage a layer surface including its subsurfaces and popups
  */
 void
 phoc_layer_surface_damage (PhocLayerSurface *self)
 {
   struct wlr_layer_surface_v1 *wlr_layer_surface;
   struct wlr_output *wlr_output;
+  PhocLayerSurfaceDamageData data;
 
   g_assert (PHOC_IS_LAYER_SURFACE (self));
   wlr_layer_surface = self->layer_surface;
@@ -207,10 +222,15 @@ phoc_layer_surface_damage (PhocLayerSurface *self)
   if (!wlr_output)
     return;
 
-  phoc_output_damage_whole_surface (PHOC_OUTPUT (wlr_output->data),
-                                    wlr_layer_surface->surface,
-                                    self->geo.x,
-                                    self->geo.y);
+  data = (PhocLayerSurfaceDamageData) {
+    .output = PHOC_OUTPUT (wlr_output->data),
+    .ox = self->geo.x,
+    .oy = self->geo.y,
+  };
+
+  phoc_output_damage_whole_surface (data.output, wlr_layer_surface->surface, data.ox, data.oy);
+  /* Popups move along with the layer surface */
+  wlr_layer_surface_v1_for_each_popup_surface (wlr_layer_surface, damage_popup_iterator, &data);
 }
 
 
@@ -43,6 +43,7 @@ struct _PhocLayerSurface {
 
   struct wlr_box geo;
   enum zwlr_layer_shell_v1_layer layer;
+  struct wlr_layer_surface_v1_state layout_state; /* state the surface was last arranged with */
   float alpha;
   bool mapped;
 };
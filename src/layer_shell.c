@@ -24,6 +24,23 @@
 #include <glib.h>
 
 #define LAYER_SHELL_LAYER_COUNT 4
+#define LAYER_BIT(l) (1 << (l))
+#define LAYER_BIT_ALL ((1 << LAYER_SHELL_LAYER_COUNT) - 1)
+
+static gboolean
+layout_changed (const struct wlr_layer_surface_v1_state *old,
+                const struct wlr_layer_surface_v1_state *new)
+{
+  return old->desired_width != new->desired_width ||
+    old->desired_height != new->desired_height ||
+    old->anchor != new->anchor ||
+    old->exclusive_zone != new->exclusive_zone ||
+    old->margin.top != new->margin.top ||
+    old->margin.right != new->margin.right ||
+    old->margin.bottom != new->margin.bottom ||
+    old->margin.left != new->margin.left ||
+    old->layer != new->layer;
+}
 
 static void
 apply_exclusive (struct wlr_box *usable_area,
@@ -140,6 +157,9 @@ arrange_layer (PhocOutput                     *output,
     if (exclusive != (state->exclusive_zone > 0))
       continue;
 
+    /* Also covers margins set by layer shell effects while dragging */
+    layer_surface->layout_state = *state;
+
     struct wlr_box bounds;
     if (state->exclusive_zone == -1)
       bounds = full_area;
@@ -247,14 +267,24 @@ phoc_layer_shell_find_osk (PhocOutput *output)
 }
 
 
-void
-phoc_layer_shell_arrange (PhocOutput *output)
+/*
+ * Arrange the layers in @dirty and whatever depends on them. Exclusive
+ * surfaces shrink the usable area from the top most layer down so a
+ * layer only needs to be arranged again if it changed or the area
+ * left by the layers above changed. Views and non exclusive surfaces
+ * only depend on the final usable area.
+ */
+static void
+layer_shell_arrange (PhocOutput *output, guint dirty, gboolean full)
 {
   PhocServer *server = phoc_server_get_default ();
   PhocDesktop *desktop = phoc_server_get_desktop (server);
   PhocInput *input = phoc_server_get_input (server);
   struct wlr_box usable_area = { 0 };
   GSList *seats = phoc_input_get_seats (input);
+  PhocLayerSurface *osk;
+  enum zwlr_layer_shell_v1_layer osk_layer;
+  gboolean usable_area_changed;
   enum zwlr_layer_shell_v1_layer layers[] = {
     ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
     ZWLR_LAYER_SHELL_V1_LAYER_TOP,
@@ -266,23 +296,43 @@ phoc_layer_shell_arrange (PhocOutput *output)
    * Whenever we rearrange layers we need to check for the OSK's layer as
    * the new surface might need it raised (or the new surface might be the OSK itself)
    */
+  osk = phoc_layer_shell_find_osk (output);
+  osk_layer = osk ? osk->layer : ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY;
   phoc_layer_shell_update_osk (output, FALSE);
+  if (osk && osk->layer != osk_layer)
+    dirty |= LAYER_BIT (osk_layer) | LAYER_BIT (osk->layer);
 
   wlr_output_effective_resolution (output->wlr_output, &usable_area.width, &usable_area.height);
   // Arrange exclusive surfaces from top->bottom
-  for (size_t i = 0; i < G_N_ELEMENTS (layers); ++i)
-    arrange_layer (output, seats, layers[i], &usable_area, true);
+  for (size_t i = 0; i < G_N_ELEMENTS (layers); ++i) {
+    enum zwlr_layer_shell_v1_layer layer = layers[i];
+
+    if (!full && !(dirty & LAYER_BIT (layer)) &&
+        memcmp (&usable_area, &output->layer_area_in[layer], sizeof (struct wlr_box)) == 0) {
+      usable_area = output->layer_area_out[layer];
+      continue;
+    }
+
+    output->layer_area_in[layer] = usable_area;
+    arrange_layer (output, seats, layer, &usable_area, true);
+    output->layer_area_out[layer] = usable_area;
+  }
+  usable_area_changed = memcmp (&output->usable_area, &usable_area, sizeof (struct wlr_box)) != 0;
   output->usable_area = usable_area;
 
-  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
-    PhocView *view = PHOC_VIEW (l->data);
+  if (full || usable_area_changed) {
+    for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+      PhocView *view = PHOC_VIEW (l->data);
 
-    phoc_view_arrange (view, NULL, output->desktop->maximize);
+      phoc_view_arrange (view, NULL, output->desktop->maximize);
+    }
   }
 
   // Arrange non-exlusive surfaces from top->bottom
-  for (size_t i = 0; i < G_N_ELEMENTS (layers); ++i)
-    arrange_layer (output, seats, layers[i], &usable_area, false);
+  for (size_t i = 0; i < G_N_ELEMENTS (layers); ++i) {
+    if (full || usable_area_changed || (dirty & LAYER_BIT (layers[i])))
+      arrange_layer (output, seats, layers[i], &usable_area, false);
+  }
 
   phoc_output_update_shell_reveal (output);
 
@@ -303,6 +353,32 @@ phoc_layer_shell_arrange (PhocOutput *output)
   }
 }
 
+/**
+ * phoc_layer_shell_arrange:
+ * @output: The output to arrange
+ *
+ * Arrange all layer surfaces and views on @output.
+ */
+void
+phoc_layer_shell_arrange (PhocOutput *output)
+{
+  layer_shell_arrange (output, LAYER_BIT_ALL, TRUE);
+}
+
+/**
+ * phoc_layer_shell_arrange_layer:
+ * @output: The output to arrange
+ * @layer: The layer that changed
+ *
+ * Arrange the layer surfaces in @layer. Other layers and views are
+ * only arranged if they're affected by the change.
+ */
+void
+phoc_layer_shell_arrange_layer (PhocOutput *output, enum zwlr_layer_shell_v1_layer layer)
+{
+  layer_shell_arrange (output, LAYER_BIT (layer), FALSE);
+}
+
 
 void
 phoc_layer_shell_update_focus (void)
@@ -379,12 +455,19 @@ handle_surface_commit (struct wl_listener *listener, void *data)
 
     bool layer_changed = false;
     if (wlr_layer_surface->current.committed != 0) {
-      layer_changed = layer_surface->layer != wlr_layer_surface->current.layer;
+      struct wlr_layer_surface_v1_state *current = &wlr_layer_surface->current;
+
+      layer_changed = layer_surface->layer != current->layer;
 
-      phoc_output_set_layer_dirty (output, layer_surface->layer);
+      /* Only arrange what's affected when the layout actually changed */
+      if (layer_changed || layout_changed (&layer_surface->layout_state, current)) {
+        enum zwlr_layer_shell_v1_layer old_layer = layer_surface->layer;
 
-      layer_surface->layer = wlr_layer_surface->current.layer;
-      phoc_layer_shell_arrange (output);
+        phoc_output_set_layer_dirty (output, layer_surface->layer);
+        layer_surface->layer = current->layer;
+
+        layer_shell_arrange (output, LAYER_BIT (old_layer) | LAYER_BIT (current->layer), FALSE);
+      }
       phoc_layer_shell_update_focus ();
     }
 
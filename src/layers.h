@@ -56,6 +56,7 @@ typedef struct _PhocLayerSubsurface {
 } PhocLayerSubsurface;
 
 void phoc_layer_shell_arrange (PhocOutput *output);
+void phoc_layer_shell_arrange_layer (PhocOutput *output, enum zwlr_layer_shell_v1_layer layer);
 void phoc_layer_shell_update_focus (void);
 void phoc_layer_shell_update_osk (PhocOutput *output, gboolean arrange);
 PhocLayerSurface *phoc_layer_shell_find_osk (PhocOutput *output);
@@ -97,6 +97,12 @@ static GDebugKey debug_keys[] =
  { .key = "disable-animations",
    .value = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
  },
+ { .key = "frame-timings",
+   .value = PHOC_SERVER_DEBUG_FLAG_FRAME_TIMINGS,
+ },
+ { .key = "frame-throttle",
+   .value = PHOC_SERVER_DEBUG_FLAG_FRAME_THROTTLE,
+ },
 };
 
 
@@ -159,6 +159,7 @@ on_render (PhocOutputShield *self, PhocRenderContext *ctx)
   g_debug ("%s: alpha: %f", __func__, self->alpha);
   wlr_output = self->output->wlr_output;
 
+  ctx->n_draws++;
   wlr_render_pass_add_rect (ctx->render_pass, &(struct wlr_render_rect_options){
       .box = { .width = wlr_output->width, .height = wlr_output->height },
       .color =  { .a = self->alpha },
@@ -324,3 +325,19 @@ phoc_output_shield_lower (PhocOutputShield *self)
   start_render (self);
   phoc_timed_animation_play (self->animation);
 }
+
+/**
+ * phoc_output_shield_is_rendering
+ * @self: The shield
+ *
+ * Whether the shield is currently drawn on top of the output's content.
+ *
+ * Returns: %TRUE if the shield is drawn
+ */
+gboolean
+phoc_output_shield_is_rendering (PhocOutputShield *self)
+{
+  g_return_val_if_fail (PHOC_IS_OUTPUT_SHIELD (self), FALSE);
+
+  return !!self->render_end_id;
+}
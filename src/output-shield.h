@@ -20,5 +20,6 @@ G_DECLARE_FINAL_TYPE (PhocOutputShield, phoc_output_shield, PHOC, OUTPUT_SHIELD,
 PhocOutputShield   *phoc_output_shield_new                       (PhocOutput *output);
 void                phoc_output_shield_raise                     (PhocOutputShield *self);
 void                phoc_output_shield_lower                     (PhocOutputShield *self);
+gboolean            phoc_output_shield_is_rendering              (PhocOutputShield *self);
 
 G_END_DECLS
@@ -6,6 +6,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend/drm.h>
 #include <wlr/config.h>
@@ -13,6 +14,7 @@
 #include <wlr/render/android.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_gamma_control_v1.h>
+#include <wlr/types/wlr_output_layer.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
 #include <wlr/types/wlr_matrix.h>
@@ -22,17 +24,22 @@
 #include "anim/animatable.h"
 #include "bling.h"
 #include "cutouts-overlay.h"
+#include "frame-timings.h"
 #include "settings.h"
 #include "layers.h"
 #include "layer-shell-effects.h"
 #include "output.h"
 #include "output-shield.h"
+#include "phoc-enums.h"
 #include "render.h"
 #include "render-private.h"
+#include "refresh-policy.h"
+#include "repaint-scheduler.h"
 #include "seat.h"
 #include "server.h"
 #include "text_input.h"
 #include "utils.h"
+#include "view-private.h"
 #include "xwayland-surface.h"
 
 enum {
@@ -55,11 +62,13 @@ typedef struct _PhocOutputPrivate {
 
   GSList                  *frame_callbacks;
   gint                     frame_callback_next_id;
-  gint64                   last_frame_us;
+  gint64                   frame_time_us;
+  gint64                   last_present_us;
+  gint64                   present_period_us;
 
   PhocCutoutsOverlay      *cutouts;
   gulong                   render_cutouts_id;
-  struct wlr_texture      *cutouts_texture;
+  GPtrArray               *cutouts_tiles;
 
   gboolean shell_revealed;
   gboolean force_shell_reveal;
@@ -67,10 +76,38 @@ typedef struct _PhocOutputPrivate {
   struct wl_listener     damage;
   struct wl_listener     frame;
   struct wl_listener     needs_frame;
+  struct wl_listener     present;
   struct wl_listener     request_state;
 
   PhocOutputScaleFilter  scale_filter;
   gboolean               gamma_lut_changed;
+  PhocOutputScanout      scanout_status;
+
+  /* Output layers (hardware planes) for layer surfaces and drag icons */
+  struct wlr_output_layer       *layers[PHOC_RENDERER_MAX_OFFLOADED];
+  struct wlr_output_layer_state  layer_states[PHOC_RENDERER_MAX_OFFLOADED];
+  struct wlr_surface            *offloaded[PHOC_RENDERER_MAX_OFFLOADED];
+  guint                          n_offloaded;
+  struct wlr_surface            *rejected[PHOC_RENDERER_MAX_OFFLOADED];
+  guint                          n_rejected;
+  PhocOutputTestFunc             layers_test_func;
+  gpointer                       layers_test_data;
+
+  /* Timing of the frame being drawn and the recorded ones */
+  PhocFrameTiming        frame_timing;
+  PhocFrameTimings      *frame_timings;
+
+  /* Delays repaints towards the vblank deadline */
+  PhocRepaintScheduler  *repaint_scheduler;
+  guint                  repaint_id;
+
+  /* Content driven refresh rate switching */
+  int                     low_refresh_mhz;
+  struct wlr_output_mode *high_mode;
+  struct wlr_output_mode *low_mode;
+  struct wlr_output_mode *refresh_mode;
+  PhocRefreshPolicy      *refresh_policy;
+  guint                   refresh_policy_id;
 
   GQueue                *layer_surfaces[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
 } PhocOutputPrivate;
@@ -87,6 +124,9 @@ G_DEFINE_TYPE_WITH_CODE (PhocOutput, phoc_output, G_TYPE_OBJECT,
 
 #define PHOC_OUTPUT_SELF(p) PHOC_PRIV_CONTAINER(PHOC_OUTPUT, PhocOutput, (p))
 
+#define PHOC_OUTPUT_REFRESH_POLICY_INTERVAL_MS 1000
+#define PHOC_OUTPUT_FRAME_TIMINGS_SIZE 240
+
 static void phoc_output_for_each_surface (PhocOutput          *self,
                                           PhocSurfaceIterator  iterator,
                                           void                *user_data,
@@ -234,6 +274,200 @@ phoc_output_animatable_interface_init (PhocAnimatableInterface *iface)
 
 /* }}} */
 
+/* {{{ Refresh policy */
+
+static struct wlr_output_mode *
+find_low_refresh_mode (PhocOutput *self, struct wlr_output_mode *high_mode, int min_mhz)
+{
+  struct wlr_output_mode *mode, *low_mode = NULL;
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    if (mode->width != high_mode->width || mode->height != high_mode->height)
+      continue;
+
+    if (mode->refresh < min_mhz || mode->refresh >= high_mode->refresh)
+      continue;
+
+    if (low_mode == NULL || mode->refresh < low_mode->refresh)
+      low_mode = mode;
+  }
+
+  return low_mode;
+}
+
+/* The mode gets applied with the next repaint to avoid an extra modeset commit */
+static void
+request_refresh_mode (PhocOutput *self, struct wlr_output_mode *mode)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (self->wlr_output->current_mode == mode) {
+    priv->refresh_mode = NULL;
+    return;
+  }
+
+  priv->refresh_mode = mode;
+  phoc_output_damage_whole (self);
+}
+
+
+static PhocRefreshRate
+get_refresh_rate (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  return self->wlr_output->current_mode == priv->low_mode ?
+    PHOC_REFRESH_RATE_LOW : PHOC_REFRESH_RATE_HIGH;
+}
+
+
+static void
+refresh_policy_evaluate (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocRefreshRate current = get_refresh_rate (self);
+  PhocRefreshRate rate;
+
+  rate = phoc_refresh_policy_evaluate (priv->refresh_policy,
+                                       current,
+                                       !!priv->frame_callbacks,
+                                       g_get_monotonic_time ());
+  if (rate == current)
+    return;
+
+  g_debug ("Output '%s': Switching to %dmHz", self->wlr_output->name,
+           rate == PHOC_REFRESH_RATE_LOW ? priv->low_mode->refresh : priv->high_mode->refresh);
+  request_refresh_mode (self, rate == PHOC_REFRESH_RATE_LOW ? priv->low_mode : priv->high_mode);
+}
+
+
+static gboolean
+on_refresh_policy_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  g_assert (priv->low_mode);
+
+  refresh_policy_evaluate (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/*
+ * At the high rate the timer notices when the content slows down. At
+ * the low rate there's no need to wake up: Input and animations mark
+ * the output busy and content outpacing the low rate is checked when
+ * frames get committed.
+ */
+static void
+update_refresh_policy_timer (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gboolean needed;
+
+  needed = priv->low_mode && self->wlr_output->enabled &&
+    get_refresh_rate (self) == PHOC_REFRESH_RATE_HIGH;
+
+  if (!needed) {
+    g_clear_handle_id (&priv->refresh_policy_id, g_source_remove);
+    return;
+  }
+
+  if (priv->refresh_policy_id)
+    return;
+
+  phoc_refresh_policy_reset (priv->refresh_policy, g_get_monotonic_time ());
+  priv->refresh_policy_id = g_timeout_add (PHOC_OUTPUT_REFRESH_POLICY_INTERVAL_MS,
+                                           on_refresh_policy_timeout,
+                                           self);
+  g_source_set_name_by_id (priv->refresh_policy_id, "[phoc] output refresh policy");
+}
+
+/**
+ * update_refresh_policy:
+ * @self: The output
+ *
+ * (Re)evaluate the modes available for switching the refresh rate
+ * based on the current mode. The current mode is assumed to be the
+ * one to use during input and animations.
+ */
+static void
+update_refresh_policy (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output *wlr_output = self->wlr_output;
+
+  g_clear_handle_id (&priv->refresh_policy_id, g_source_remove);
+  g_clear_pointer (&priv->refresh_policy, phoc_refresh_policy_free);
+  priv->high_mode = priv->low_mode = priv->refresh_mode = NULL;
+
+  /* VRR takes care of lowering the refresh rate itself */
+  if (priv->low_refresh_mhz <= 0 ||
+      wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ||
+      wlr_output->current_mode == NULL)
+    return;
+
+  priv->high_mode = wlr_output->current_mode;
+  priv->low_mode = find_low_refresh_mode (self, priv->high_mode, priv->low_refresh_mhz);
+  if (priv->low_mode == NULL) {
+    g_warning ("Output '%s': No mode with a refresh rate >= %dmHz",
+               wlr_output->name, priv->low_refresh_mhz);
+    return;
+  }
+
+  g_debug ("Output '%s': Switching between %dmHz and %dmHz",
+           wlr_output->name, priv->high_mode->refresh, priv->low_mode->refresh);
+  priv->refresh_policy = phoc_refresh_policy_new (priv->low_mode->refresh,
+                                                  g_get_monotonic_time ());
+  update_refresh_policy_timer (self);
+}
+
+
+static void
+refresh_policy_frame_done (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->low_mode == NULL)
+    return;
+
+  phoc_refresh_policy_frame_done (priv->refresh_policy);
+
+  /* The timer isn't running at the low rate, check whether content outpaces it here */
+  if (get_refresh_rate (self) == PHOC_REFRESH_RATE_LOW &&
+      phoc_refresh_policy_is_due (priv->refresh_policy, g_get_monotonic_time ()))
+    refresh_policy_evaluate (self);
+}
+
+
+static void
+refresh_policy_content_update (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->low_mode == NULL)
+    return;
+
+  phoc_refresh_policy_content_update (priv->refresh_policy);
+}
+
+
+static void
+refresh_policy_mark_busy (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->low_mode == NULL)
+    return;
+
+  phoc_refresh_policy_mark_busy (priv->refresh_policy);
+  if (self->wlr_output->current_mode == priv->low_mode || priv->refresh_mode == priv->low_mode)
+    request_refresh_mode (self, priv->high_mode);
+}
+
+/* }}} */
+
 static void
 phoc_output_init (PhocOutput *self)
 {
@@ -241,13 +475,14 @@ phoc_output_init (PhocOutput *self)
   PhocOutputPrivate *priv = phoc_output_get_instance_private(self);
 
   priv->frame_callback_next_id = 1;
-  priv->last_frame_us = g_get_monotonic_time ();
   priv->shield = phoc_output_shield_new (self);
+  priv->repaint_scheduler = phoc_repaint_scheduler_new ();
 
   self->debug_touch_points = NULL;
   wl_list_init (&self->layer_surfaces);
 
   priv->scale_filter = PHOC_OUTPUT_SCALE_FILTER_AUTO;
+  priv->scanout_status = PHOC_OUTPUT_SCANOUT_NO_SURFACE;
 
   priv->renderer = g_object_ref (phoc_server_get_renderer (server));
 }
@@ -267,6 +502,9 @@ update_output_manager_config (PhocDesktop *desktop)
   struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create ();
   PhocOutput *output;
 
+  /* Cached test results are only valid for the current configuration */
+  g_hash_table_remove_all (desktop->output_config_tests);
+
   wl_list_for_each (output, &desktop->outputs, link) {
     struct wlr_output_configuration_head_v1 *config_head;
     struct wlr_box output_box;
@@ -286,6 +524,11 @@ static void
 phoc_output_handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocOutput *self = wl_container_of (listener, self, output_destroy);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  for (int i = 0; i < PHOC_RENDERER_MAX_OFFLOADED; i++)
+    g_clear_pointer (&priv->layers[i], wlr_output_layer_destroy);
+  priv->n_offloaded = 0;
 
   if (self->fullscreen_view)
     phoc_view_set_fullscreen (self->fullscreen_view, false, NULL);
@@ -301,15 +544,40 @@ render_cutouts (PhocOutput *self, PhocRenderContext *ctx)
 
   g_assert (PHOC_IS_OUTPUT (self));
 
-  if (priv->cutouts_texture) {
-    struct wlr_texture *texture = priv->cutouts_texture;
+  if (ctx->output != self)
+    return;
 
-    wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
-        .texture = texture,
-        .transform = WL_OUTPUT_TRANSFORM_NORMAL,
-        .filter_mode = phoc_output_get_texture_filter_mode (ctx->output),
-    });
+  if (priv->cutouts_tiles == NULL || !pixman_region32_not_empty (ctx->damage))
+    return;
+
+  /* The tiles are in panel (buffer) coordinates */
+  pixman_region32_t damage;
+  pixman_region32_init (&damage);
+  pixman_region32_copy (&damage, ctx->damage);
+  phoc_output_transform_damage (self, &damage);
+
+  /* The overlay is static so it only needs to be redrawn where other
+   * content got repainted */
+  for (guint i = 0; i < priv->cutouts_tiles->len; i++) {
+    PhocCutoutsOverlayTile *tile = g_ptr_array_index (priv->cutouts_tiles, i);
+    pixman_region32_t clip;
+
+    pixman_region32_init_rect (&clip, tile->box.x, tile->box.y, tile->box.width, tile->box.height);
+    pixman_region32_intersect (&clip, &clip, &damage);
+    if (pixman_region32_not_empty (&clip)) {
+      ctx->n_draws++;
+      wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
+          .texture = tile->texture,
+          .dst_box = tile->box,
+          .transform = WL_OUTPUT_TRANSFORM_NORMAL,
+          .clip = &clip,
+          .filter_mode = phoc_output_get_texture_filter_mode (ctx->output),
+        });
+    }
+    pixman_region32_fini (&clip);
   }
+
+  pixman_region32_fini (&damage);
 }
 
 
@@ -360,81 +628,206 @@ surface_send_frame_done_iterator (PhocOutput         *output,
 }
 
 
+static const char *
+scanout_status_to_string (PhocOutputScanout status)
+{
+  g_autoptr (GEnumClass) eclass = NULL;
+  GEnumValue *ev;
+
+  eclass = G_ENUM_CLASS (g_type_class_ref (phoc_output_scanout_get_type ()));
+  ev = g_enum_get_value (eclass, status);
+
+  return ev ? ev->value_nick : "unknown";
+}
+
+
 static void
-count_surface_iterator (PhocOutput         *output,
-                        struct wlr_surface *surface,
-                        struct wlr_box     *box,
-                        float               scale,
-                        void               *data)
+set_scanout_status (PhocOutput *self, PhocOutputScanout status)
 {
-  size_t *n = data;
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (priv->scanout_status == status)
+    return;
 
-  (*n)++;
+  g_debug ("Output '%s': direct scanout %s", self->wlr_output->name,
+           scanout_status_to_string (status));
+  priv->scanout_status = status;
 }
 
 
 PHOC_TRACE_NO_INLINE static bool
-scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_state *pending)
+scan_out_surface (PhocOutput *self, struct wlr_output_state *pending)
 {
-  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_output *wlr_output = self->wlr_output;
-  size_t n_surfaces = 0;
+  PhocOutputScanout status;
   struct wlr_surface *wlr_surface;
 
-  g_assert (PHOC_IS_VIEW (view));
+  wlr_surface = phoc_renderer_find_scanout_surface (priv->renderer, self, &status);
+  if (wlr_surface == NULL)
+    goto out;
 
-  for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
-    PhocSeat *seat = PHOC_SEAT (elem->data);
-    PhocDragIcon *drag_icon;
+  if (!wlr_output_is_direct_scanout_allowed (wlr_output)) {
+    status = PHOC_OUTPUT_SCANOUT_NOT_ALLOWED;
+    goto out;
+  }
 
-    g_assert (PHOC_IS_SEAT (seat));
-    drag_icon = seat->drag_icon;
+  wlr_output_state_set_buffer (pending, &wlr_surface->buffer->base);
+  if (!wlr_output_test_state (wlr_output, pending)) {
+    status = PHOC_OUTPUT_SCANOUT_TEST_FAILED;
+    goto out;
+  }
+
+  wlr_presentation_surface_scanned_out_on_output (self->desktop->presentation,
+                                                  wlr_surface,
+                                                  wlr_output);
 
-    if (phoc_drag_icon_is_mapped (drag_icon))
-      return false;
+  if (!wlr_output_commit_state (wlr_output, pending)) {
+    status = PHOC_OUTPUT_SCANOUT_TEST_FAILED;
+    goto out;
   }
 
-  if (phoc_output_has_layer (self, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY))
-    return false;
+ out:
+  set_scanout_status (self, status);
+  return status == PHOC_OUTPUT_SCANOUT_OK;
+}
 
-  if (!phoc_view_is_mapped (view))
-    return false;
 
-  phoc_output_view_for_each_surface (self, view, count_surface_iterator, &n_surfaces);
-  if (n_surfaces > 1)
-    return false;
+static gboolean
+test_layers (PhocOutput *self, struct wlr_output_state *pending)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
 
-#ifdef PHOC_XWAYLAND
-  if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-    struct wlr_xwayland_surface *xsurface =
-      phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
-    if (!wl_list_empty (&xsurface->children)) {
-      return false;
+  if (priv->layers_test_func)
+    return priv->layers_test_func (self, pending, priv->layers_test_data);
+
+  return wlr_output_test_state (self->wlr_output, pending);
+}
+
+
+static void
+clear_layers (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  for (int i = 0; i < PHOC_RENDERER_MAX_OFFLOADED; i++)
+    priv->layer_states[i].buffer = NULL;
+}
+
+
+static void
+set_offloaded (PhocOutput *self, struct wlr_surface **surfaces, guint n)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  /* Surfaces moving between planes and composition need a full repaint */
+  if (n != priv->n_offloaded ||
+      memcmp (surfaces, priv->offloaded, n * sizeof (struct wlr_surface *)) != 0) {
+    g_debug ("Output '%s': %u surfaces on output layers", self->wlr_output->name, n);
+    wlr_damage_ring_add_whole (&self->damage_ring);
+  }
+
+  memcpy (priv->offloaded, surfaces, n * sizeof (struct wlr_surface *));
+  priv->n_offloaded = n;
+}
+
+/*
+ * Put the front most layer surfaces and drag icons on output layers so
+ * e.g. the OSK or a panel don't force composition of the whole output.
+ * Whatever the backend rejects is composited as usual.
+ */
+PHOC_TRACE_NO_INLINE static void
+assign_layers (PhocOutput *self, struct wlr_output_state *pending)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_surface *surfaces[PHOC_RENDERER_MAX_OFFLOADED];
+  struct wlr_box boxes[PHOC_RENDERER_MAX_OFFLOADED];
+  guint n = 0, accepted = 0;
+  gboolean allowed;
+
+  if (priv->layers[0] == NULL)
+    return;
+
+  /* Planes bypass screencopy and software cursors. Overlays like the
+   * shield and debug aids get drawn into the primary buffer at render
+   * end so planes would end up stacked above them. */
+  allowed = wlr_output_is_direct_scanout_allowed (self->wlr_output) &&
+    !phoc_output_has_overlays (self) &&
+    !phoc_server_check_debug_flags (server,
+                                    PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING |
+                                    PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS);
+  if (allowed) {
+    n = phoc_renderer_get_layer_candidates (priv->renderer, self, surfaces, boxes,
+                                            PHOC_RENDERER_MAX_OFFLOADED);
+  }
+
+  /* Don't bother the backend again with what it rejected last time */
+  if (n == priv->n_rejected &&
+      memcmp (surfaces, priv->rejected, n * sizeof (struct wlr_surface *)) == 0)
+    n = 0;
+
+  /* Nothing to show and nothing to take down */
+  if (n == 0 && priv->n_offloaded == 0)
+    return;
+
+  /* Output layers stack bottom to top while candidates are front to back */
+  for (int i = 0; i < PHOC_RENDERER_MAX_OFFLOADED; i++) {
+    struct wlr_output_layer_state *state = &priv->layer_states[i];
+
+    *state = (struct wlr_output_layer_state) { .layer = priv->layers[i] };
+    if ((guint)i < n) {
+      guint c = n - 1 - i;
+
+      wlr_surface_get_buffer_source_box (surfaces[c], &state->src_box);
+      phoc_output_transform_box (self, &boxes[c]);
+      state->dst_box = boxes[c];
+      state->buffer = &surfaces[c]->buffer->base;
     }
   }
-#endif
+  wlr_output_state_set_layers (pending, priv->layer_states, PHOC_RENDERER_MAX_OFFLOADED);
 
-  wlr_surface = view->wlr_surface;
-  if (wlr_surface->buffer == NULL)
-    return false;
+  if (n == 0)
+    goto out;
 
-  if ((float)wlr_surface->current.scale != wlr_output->scale ||
-      wlr_surface->current.transform != wlr_output->transform) {
-    return false;
+  if (test_layers (self, pending)) {
+    while (accepted < n && priv->layer_states[n - 1 - accepted].accepted)
+      accepted++;
   }
 
-  if (!wlr_output_is_direct_scanout_allowed (wlr_output))
-    return false;
+  if (accepted < n) {
+    /* Keep what was accepted from the front, composite the rest */
+    for (guint c = accepted; c < n; c++)
+      priv->layer_states[n - 1 - c].buffer = NULL;
 
-  wlr_output_state_set_buffer (pending, &wlr_surface->buffer->base);
-  if (!wlr_output_test_state (wlr_output, pending))
-    return false;
+    if (accepted && !test_layers (self, pending)) {
+      clear_layers (self);
+      accepted = 0;
+    }
+  }
 
-  wlr_presentation_surface_scanned_out_on_output (self->desktop->presentation,
-                                                  wlr_surface,
-                                                  wlr_output);
+  priv->n_rejected = 0;
+  if (accepted == 0) {
+    memcpy (priv->rejected, surfaces, n * sizeof (struct wlr_surface *));
+    priv->n_rejected = n;
+  }
 
-  return wlr_output_commit_state (wlr_output, pending);
+  for (guint c = 0; c < accepted; c++) {
+    wlr_presentation_surface_scanned_out_on_output (self->desktop->presentation,
+                                                    surfaces[c],
+                                                    self->wlr_output);
+  }
+
+ out:
+  /* Backends without output layer support might reject the state */
+  if (accepted == 0 && priv->n_offloaded == 0) {
+    pending->committed &= ~WLR_OUTPUT_STATE_LAYERS;
+    pending->layers = NULL;
+    pending->layers_len = 0;
+  }
+
+  set_offloaded (self, surfaces, accepted);
+  phoc_renderer_set_offloaded_surfaces (priv->renderer, priv->offloaded, priv->n_offloaded);
 }
 
 
@@ -460,6 +853,126 @@ get_frame_damage (PhocOutput *self, pixman_region32_t *frame_damage)
 }
 
 
+static guint64
+region_area (pixman_region32_t *region)
+{
+  pixman_box32_t *rects;
+  guint64 area = 0;
+  int n_rects;
+
+  rects = pixman_region32_rectangles (region, &n_rects);
+  for (int i = 0; i < n_rects; i++)
+    area += (guint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+  return area;
+}
+
+
+static gint64
+get_refresh_period_us (PhocOutput *self)
+{
+  if (self->wlr_output->refresh <= 0)
+    return 0;
+
+  /* Refresh rate is in mHz */
+  return (G_USEC_PER_SEC * (gint64)1000) / self->wlr_output->refresh;
+}
+
+/* {{{ Frame clock */
+
+static gint64
+get_frame_interval_us (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  return priv->present_period_us ?: get_refresh_period_us (self);
+}
+
+
+static void
+phoc_output_handle_present (struct wl_listener *listener, void *data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, present);
+  struct wlr_output_event_present *event = data;
+
+  if (!event->presented || event->when == NULL)
+    return;
+
+  /* DRM presents using CLOCK_MONOTONIC like g_get_monotonic_time () */
+  priv->last_present_us = event->when->tv_sec * G_USEC_PER_SEC + event->when->tv_nsec / 1000;
+  /* Refresh is in ns, 0 if unknown or variable */
+  priv->present_period_us = event->refresh / 1000;
+
+  phoc_repaint_scheduler_presented (priv->repaint_scheduler, priv->last_present_us,
+                                    get_frame_interval_us (PHOC_OUTPUT_SELF (priv)));
+}
+
+
+/*
+ * Predict when the frame that is being built will be presented: That's
+ * the first vblank after now on the grid given by the last presentation
+ * feedback and the frame interval. Animations use this instead of the
+ * time the frame handler happens to run so scheduling jitter doesn't
+ * show up in the motion.
+ */
+static gint64
+update_frame_time (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 now_us = g_get_monotonic_time ();
+  gint64 period_us = get_frame_interval_us (self);
+  gint64 frame_time_us;
+
+  if (period_us <= 0) {
+    frame_time_us = now_us;
+  } else if (priv->last_present_us == 0 || priv->last_present_us > now_us) {
+    frame_time_us = now_us + period_us;
+  } else {
+    gint64 n_frames = (now_us - priv->last_present_us) / period_us + 1;
+
+    frame_time_us = priv->last_present_us + n_frames * period_us;
+  }
+
+  /* Never go back in time, e.g. when the refresh rate changed */
+  priv->frame_time_us = MAX (frame_time_us, priv->frame_time_us);
+  return priv->frame_time_us;
+}
+
+/* }}} */
+
+
+static void
+record_frame_timing (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocFrameTiming *timing = &priv->frame_timing;
+  gint64 budget_us;
+
+  timing->commit_us = g_get_monotonic_time () - timing->frame_us;
+
+  DTRACE_PROBE6 (phoc, output_frame_end, self->wlr_output->name,
+                 timing->render_us, timing->commit_us, timing->damage_area,
+                 timing->n_draws, timing->scanned_out);
+
+  if (G_LIKELY (priv->frame_timings == NULL))
+    return;
+
+  phoc_frame_timings_add (priv->frame_timings, timing);
+
+  budget_us = get_refresh_period_us (self);
+  if (budget_us == 0)
+    return;
+
+  if (timing->commit_us > budget_us) {
+    g_message ("Output '%s': Frame took %" G_GINT64_FORMAT "us (budget %" G_GINT64_FORMAT "us), "
+               "render %" G_GINT64_FORMAT "us, damage %" G_GUINT64_FORMAT "px, "
+               "%u draws, scanout: %d, committed: %d",
+               self->wlr_output->name, timing->commit_us, budget_us, timing->render_us,
+               timing->damage_area, timing->n_draws, timing->scanned_out, timing->committed);
+  }
+}
+
+
 PHOC_TRACE_NO_INLINE static void
 phoc_output_draw (PhocOutput *self)
 {
@@ -472,6 +985,7 @@ phoc_output_draw (PhocOutput *self)
   struct wlr_buffer *buffer;
   struct wlr_render_pass *render_pass;
   struct wlr_output_state pending = { 0 };
+  gint64 render_start_us;
 
   if (!wlr_output->enabled)
     return;
@@ -486,12 +1000,19 @@ phoc_output_draw (PhocOutput *self)
   if (G_UNLIKELY (priv->gamma_lut_changed))
     phoc_output_set_gamma_lut (self, &pending);
 
+  assign_layers (self, &pending);
+
+  if (G_UNLIKELY (priv->refresh_mode))
+    wlr_output_state_set_mode (&pending, priv->refresh_mode);
+
   pending.committed |= WLR_OUTPUT_STATE_DAMAGE;
   get_frame_damage (self, &pending.damage);
+  priv->frame_timing.damage_area = region_area (&pending.damage);
 
-  /* Check if we can delegate the fullscreen surface to the output */
-  if (phoc_output_has_fullscreen_view (self))
-    scanned_out = scan_out_fullscreen_view (self, self->fullscreen_view, &pending);
+  /* Check if we can delegate a single surface to the output */
+  scanned_out = scan_out_surface (self, &pending);
+  priv->frame_timing.scanned_out = scanned_out;
+  priv->frame_timing.committed = scanned_out;
 
   if (scanned_out)
     goto out;
@@ -521,34 +1042,66 @@ phoc_output_draw (PhocOutput *self)
     .alpha = 1.0,
     .render_pass = render_pass,
   };
+  render_start_us = g_get_monotonic_time ();
   phoc_renderer_render_output (priv->renderer, self, &render_context);
+  priv->frame_timing.n_draws = render_context.n_draws;
 
   pixman_region32_fini (&buffer_damage);
 
+  /* Submitting flushes the GPU commands so include it in the render time */
   if (!wlr_render_pass_submit (render_pass)) {
     wlr_buffer_unlock (buffer);
     goto out;
   }
+  priv->frame_timing.render_us = g_get_monotonic_time () - render_start_us;
 
   wlr_output_state_set_buffer (&pending, buffer);
   wlr_buffer_unlock (buffer);
 
-  if (!wlr_output_commit_state (wlr_output, &pending))
+  if (!wlr_output_commit_state (wlr_output, &pending)) {
+    /* Composite everything next time */
+    if (priv->n_offloaded) {
+      memcpy (priv->rejected, priv->offloaded, priv->n_offloaded * sizeof (struct wlr_surface *));
+      priv->n_rejected = priv->n_offloaded;
+      set_offloaded (self, NULL, 0);
+      wlr_output_schedule_frame (wlr_output);
+    }
     goto out;
+  }
 
+  priv->frame_timing.committed = TRUE;
   wlr_damage_ring_rotate (&self->damage_ring);
 
  out:
+  if (G_UNLIKELY (priv->refresh_mode)) {
+    if (!priv->frame_timing.committed) {
+      g_warning ("Output '%s': Failed to switch to %dmHz, disabling refresh rate switching",
+                 wlr_output->name, priv->refresh_mode->refresh);
+      g_clear_handle_id (&priv->refresh_policy_id, g_source_remove);
+      priv->low_mode = NULL;
+    } else {
+      /* Frames committed at the previous rate don't count */
+      phoc_refresh_policy_reset (priv->refresh_policy, g_get_monotonic_time ());
+    }
+    priv->refresh_mode = NULL;
+    update_refresh_policy_timer (self);
+  }
+
+  record_frame_timing (self);
+  phoc_renderer_set_offloaded_surfaces (priv->renderer, NULL, 0);
   wlr_output_state_finish (&pending);
 }
 
 
 static void
-phoc_output_handle_frame (struct wl_listener *listener, void *data)
+phoc_output_repaint (PhocOutput *self)
 {
-  PhocOutputPrivate *priv = wl_container_of (listener, priv, frame);
-  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct timespec now;
+  gint64 frame_time_us = 0;
+
+  if (priv->frame_callbacks)
+    frame_time_us = update_frame_time (self);
 
   /* Process all registered frame callbacks */
   GSList *l = priv->frame_callbacks;
@@ -557,24 +1110,22 @@ phoc_output_handle_frame (struct wl_listener *listener, void *data)
     PhocOutputFrameCallbackInfo *cb_info = l->data;
     gboolean ret;
 
-    ret = cb_info->callback(cb_info->animatable, priv->last_frame_us, cb_info->user_data);
+    ret = cb_info->callback(cb_info->animatable, frame_time_us, cb_info->user_data);
     if (ret == G_SOURCE_REMOVE) {
       phoc_output_frame_callback_info_free (cb_info);
       priv->frame_callbacks = g_slist_delete_link (priv->frame_callbacks, l);
     }
     l = next;
   }
-  priv->last_frame_us = g_get_monotonic_time ();
-
-  /* Ensure the cutouts are drawn */
-  if (G_UNLIKELY (priv->cutouts_texture)) {
-    struct wlr_box box = { 0, 0, priv->cutouts_texture->width, priv->cutouts_texture->height };
-    if (wlr_damage_ring_add_box (&self->damage_ring, &box))
-      wlr_output_schedule_frame (self->wlr_output);
-  }
 
   /* Repaint the output */
   phoc_output_draw (self);
+  if (priv->frame_timing.committed) {
+    refresh_policy_frame_done (self);
+    /* Scanned out frames don't tell anything about render durations */
+    if (!priv->frame_timing.scanned_out)
+      phoc_repaint_scheduler_frame_done (priv->repaint_scheduler, priv->frame_timing.render_us);
+  }
 
   /* Send frame done events to all visible surfaces */
   clock_gettime (CLOCK_MONOTONIC, &now);
@@ -586,6 +1137,65 @@ phoc_output_handle_frame (struct wl_listener *listener, void *data)
 }
 
 
+static gboolean
+on_repaint_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  priv->repaint_id = 0;
+  phoc_output_repaint (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+repaint_source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  return callback (user_data);
+}
+
+/* Timeouts have ms granularity, wake up at the exact deadline instead */
+static GSourceFuncs repaint_source_funcs = {
+  .dispatch = repaint_source_dispatch,
+};
+
+
+static void
+phoc_output_handle_frame (struct wl_listener *listener, void *data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, frame);
+  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  GSource *source;
+  gint64 delay_us;
+
+  /* A repaint is already pending for this frame */
+  if (priv->repaint_id)
+    return;
+
+  priv->frame_timing = (PhocFrameTiming) { .frame_us = g_get_monotonic_time () };
+  DTRACE_PROBE1 (phoc, output_frame_begin, self->wlr_output->name);
+
+  delay_us = phoc_repaint_scheduler_get_delay (priv->repaint_scheduler,
+                                               priv->frame_timing.frame_us,
+                                               get_refresh_period_us (self));
+  DTRACE_PROBE2 (phoc, output_repaint_delay, self->wlr_output->name, delay_us);
+  if (delay_us == 0) {
+    phoc_output_repaint (self);
+    return;
+  }
+
+  source = g_source_new (&repaint_source_funcs, sizeof (GSource));
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_ready_time (source, priv->frame_timing.frame_us + delay_us);
+  g_source_set_callback (source, on_repaint_timeout, self, NULL);
+  g_source_set_name (source, "[phoc] output repaint");
+  priv->repaint_id = g_source_attach (source, NULL);
+  g_source_unref (source);
+}
+
+
 static void
 phoc_output_handle_needs_frame (struct wl_listener *listener, void *user_data)
 {
@@ -605,7 +1215,7 @@ update_output_scale_iterator (PhocOutput         *self,
 
 
 {
-  phoc_utils_wlr_surface_update_scales (surface);
+  phoc_utils_wlr_surface_update_scales_full (surface, scale);
 }
 
 
@@ -644,6 +1254,16 @@ phoc_output_handle_commit (struct wl_listener *listener, void *data)
 
   if (event->state->committed & WLR_OUTPUT_STATE_SCALE)
     phoc_output_for_each_surface (self, update_output_scale_iterator, NULL, FALSE);
+
+  /* Mode changed by something else than the refresh policy */
+  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+                                 WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED) &&
+      priv->refresh_mode == NULL) {
+    update_refresh_policy (self);
+  } else if (event->state->committed & WLR_OUTPUT_STATE_ENABLED) {
+    /* No need to measure the content's rate while disabled */
+    update_refresh_policy_timer (self);
+  }
 }
 
 
@@ -806,6 +1426,15 @@ phoc_output_fill_state (PhocOutput              *self,
 
     wlr_output_state_set_transform (pending, transform);
     priv->scale_filter = output_config->scale_filter;
+
+    if (output_config->adaptive_sync) {
+      wlr_output_state_set_adaptive_sync_enabled (pending, true);
+      if (!wlr_output_test_state (self->wlr_output, pending)) {
+        g_warning ("Adaptive sync not supported on %s", self->wlr_output->name);
+        wlr_output_state_set_adaptive_sync_enabled (pending, false);
+      }
+    }
+    priv->low_refresh_mhz = (int)(output_config->low_refresh_rate * 1000);
   } else if (enable) {
     enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
 
@@ -873,6 +1502,9 @@ phoc_output_initable_init (GInitable    *initable,
 
   wlr_damage_ring_init (&self->damage_ring);
 
+  for (int i = 0; i < PHOC_RENDERER_MAX_OFFLOADED; i++)
+    priv->layers[i] = wlr_output_layer_create (self->wlr_output);
+
   self->output_destroy.notify = phoc_output_handle_destroy;
   wl_signal_add (&self->wlr_output->events.destroy, &self->output_destroy);
 
@@ -888,6 +1520,9 @@ phoc_output_initable_init (GInitable    *initable,
   priv->needs_frame.notify = phoc_output_handle_needs_frame;
   wl_signal_add (&self->wlr_output->events.needs_frame, &priv->needs_frame);
 
+  priv->present.notify = phoc_output_handle_present;
+  wl_signal_add (&self->wlr_output->events.present, &priv->present);
+
   priv->request_state.notify = handle_request_state;
   wl_signal_add (&self->wlr_output->events.request_state, &priv->request_state);
 
@@ -921,7 +1556,7 @@ phoc_output_initable_init (GInitable    *initable,
     priv->cutouts = phoc_cutouts_overlay_new (phoc_server_get_compatibles (server));
     if (priv->cutouts) {
       g_message ("Adding cutouts overlay");
-      priv->cutouts_texture = phoc_cutouts_overlay_get_cutouts_texture (priv->cutouts, self);
+      priv->cutouts_tiles = phoc_cutouts_overlay_get_tiles (priv->cutouts, self);
       priv->render_cutouts_id = g_signal_connect_swapped (renderer, "render-end",
                                                           G_CALLBACK (render_cutouts),
                                                           self);
@@ -930,6 +1565,9 @@ phoc_output_initable_init (GInitable    *initable,
     }
   }
 
+  if (phoc_server_check_debug_flags (server, PHOC_SERVER_DEBUG_FLAG_FRAME_TIMINGS))
+    priv->frame_timings = phoc_frame_timings_new (PHOC_OUTPUT_FRAME_TIMINGS_SIZE);
+
   wlr_output_state_finish (&pending);
 
   g_message ("Output '%s' added ('%s'/'%s'/'%s'), "
@@ -964,6 +1602,10 @@ phoc_output_finalize (GObject *object)
   wl_list_remove (&priv->damage.link);
   wl_list_remove (&priv->frame.link);
   wl_list_remove (&priv->needs_frame.link);
+  wl_list_remove (&priv->present.link);
+  g_clear_handle_id (&priv->repaint_id, g_source_remove);
+  g_clear_handle_id (&priv->refresh_policy_id, g_source_remove);
+  g_clear_pointer (&priv->refresh_policy, phoc_refresh_policy_free);
   wlr_damage_ring_finish (&self->damage_ring);
 
   g_clear_list (&self->debug_touch_points, g_free);
@@ -978,8 +1620,10 @@ phoc_output_finalize (GObject *object)
   g_clear_signal_handler (&priv->render_cutouts_id, priv->renderer);
   g_clear_object (&priv->renderer);
   g_clear_object (&priv->cutouts);
-  g_clear_pointer (&priv->cutouts_texture, wlr_texture_destroy);
+  g_clear_pointer (&priv->cutouts_tiles, g_ptr_array_unref);
   g_clear_object (&priv->shield);
+  g_clear_pointer (&priv->frame_timings, phoc_frame_timings_free);
+  g_clear_pointer (&priv->repaint_scheduler, phoc_repaint_scheduler_free);
   g_clear_object (&self->desktop);
 
   G_OBJECT_CLASS (phoc_output_parent_class)->finalize (object);
@@ -1411,7 +2055,8 @@ phoc_output_drag_icons_for_each_surface (PhocOutput          *self,
  * @self: the output
  * @iterator: (scope call): The iterator
  * @user_data: Callback user data
- * @visible_only: Whether to only iterate over visible surfaces
+ * @visible_only: Whether to only iterate over visible surfaces. Views
+ *    that are occluded on this output are skipped too.
  *
  * Iterate over surfaces on the output.
  */
@@ -1440,8 +2085,14 @@ phoc_output_for_each_surface (PhocOutput          *self,
     for (GList *l = phoc_desktop_get_views (desktop)->tail; l; l = l->prev) {
       PhocView *view = PHOC_VIEW (l->data);
 
-      if (!visible_only || phoc_desktop_view_is_visible (desktop, view))
-        phoc_output_view_for_each_surface (self, view, iterator, user_data);
+      if (visible_only && (!phoc_desktop_view_is_visible (desktop, view) ||
+                           phoc_output_view_is_occluded (self, view))) {
+        /* Make sure hidden views still get (fewer) frame callbacks */
+        phoc_view_update_frame_throttle (view);
+        continue;
+      }
+
+      phoc_output_view_for_each_surface (self, view, iterator, user_data);
     }
   }
 
@@ -1465,6 +2116,119 @@ phoc_output_damage_whole (PhocOutput *self)
 }
 
 
+static void
+add_opaque_region (pixman_region32_t *occluder, struct wlr_surface *surface, int ox, int oy)
+{
+  pixman_region32_t opaque;
+
+  if (!pixman_region32_not_empty (&surface->opaque_region))
+    return;
+
+  pixman_region32_init (&opaque);
+  /* Clients may set an opaque region larger than the surface */
+  pixman_region32_intersect_rect (&opaque, &surface->opaque_region,
+                                  0, 0, surface->current.width, surface->current.height);
+  pixman_region32_translate (&opaque, ox, oy);
+  pixman_region32_union (occluder, occluder, &opaque);
+  pixman_region32_fini (&opaque);
+}
+
+/*
+ * Collect the opaque area of everything stacked above @view on the
+ * output in output local coordinates.
+ */
+static void
+collect_occluders (PhocOutput *self, PhocView *view, pixman_region32_t *occluder)
+{
+  PhocLayerSurface *layer_surface;
+
+  wl_list_for_each (layer_surface, &self->layer_surfaces, link) {
+    if (layer_surface->layer < ZWLR_LAYER_SHELL_V1_LAYER_TOP)
+      continue;
+
+    if (!layer_surface->mapped || layer_surface->alpha < 1.0f)
+      continue;
+
+    add_opaque_region (occluder, layer_surface->layer_surface->surface,
+                       layer_surface->geo.x, layer_surface->geo.y);
+  }
+
+  for (GList *l = phoc_desktop_get_views (self->desktop)->head; l; l = l->next) {
+    PhocView *above = PHOC_VIEW (l->data);
+
+    if (above == view)
+      break;
+
+    if (!phoc_view_is_mapped (above))
+      continue;
+
+    /* Keep it simple, scaled views would need rounding inwards */
+    if (phoc_view_get_alpha (above) < 1.0f || phoc_view_get_scale (above) != 1.0f)
+      continue;
+
+    add_opaque_region (occluder, above->wlr_surface,
+                       above->box.x - self->lx, above->box.y - self->ly);
+  }
+}
+
+/**
+ * phoc_output_view_is_occluded:
+ * @self: The output
+ * @view: The view to check
+ *
+ * Checks whether the parts of @view that are on @self are completely
+ * covered by opaque views or opaque layer surfaces stacked above it.
+ * A view that isn't on @self at all is considered occluded as well.
+ *
+ * Returns: %TRUE if nothing of @view is visible on @self
+ */
+gboolean
+phoc_output_view_is_occluded (PhocOutput *self, PhocView *view)
+{
+  struct wlr_box bounds, visible, output_box = { 0 };
+  pixman_region32_t occluder;
+  float scale;
+  gboolean occluded;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  if (!phoc_view_is_mapped (view))
+    return TRUE;
+
+  /* Fullscreen views are handled separately */
+  if (self->fullscreen_view)
+    return FALSE;
+
+  phoc_view_get_surface_bounds (view, &bounds);
+  if (wlr_box_empty (&bounds))
+    return FALSE;
+
+  /* Same coordinate space as phoc_output_view_for_each_surface() */
+  scale = phoc_view_get_scale (view);
+  bounds.x = floor ((view->box.x - self->lx + bounds.x) * scale);
+  bounds.y = floor ((view->box.y - self->ly + bounds.y) * scale);
+  bounds.width = ceil (bounds.width * scale) + 1;
+  bounds.height = ceil (bounds.height * scale) + 1;
+
+  wlr_output_effective_resolution (self->wlr_output, &output_box.width, &output_box.height);
+  if (!wlr_box_intersection (&visible, &output_box, &bounds))
+    return TRUE;
+
+  pixman_region32_init (&occluder);
+  collect_occluders (self, view, &occluder);
+  occluded = pixman_region32_contains_rectangle (&occluder, &(pixman_box32_t) {
+      .x1 = visible.x,
+      .y1 = visible.y,
+      .x2 = visible.x + visible.width,
+      .y2 = visible.y + visible.height,
+    }) == PIXMAN_REGION_IN;
+  pixman_region32_fini (&occluder);
+
+  return occluded;
+}
+
+
 static bool
 phoc_view_accept_damage (PhocOutput *self, PhocView  *view)
 {
@@ -1473,6 +2237,9 @@ phoc_view_accept_damage (PhocOutput *self, PhocView  *view)
   if (!phoc_desktop_view_is_visible (desktop, view))
     return false;
 
+  if (phoc_output_view_is_occluded (self, view))
+    return false;
+
   if (self->fullscreen_view == NULL)
     return true;
 
@@ -1490,52 +2257,91 @@ phoc_view_accept_damage (PhocOutput *self, PhocView  *view)
       if (fullscreen_xsurface == xsurface)
         return true;
 
-      xsurface = xsurface->parent;
-    }
-  }
-#endif
-  return false;
+      xsurface = xsurface->parent;
+    }
+  }
+#endif
+  return false;
+}
+
+/*
+ * Damage collected from a surface tree in output buffer coordinates
+ * so it can be added to the damage ring in one go.
+ */
+typedef struct {
+  bool              whole;
+  bool              schedule_frame;
+  pixman_region32_t damage;
+  pixman_region32_t surface_damage;
+} PhocOutputDamage;
+
+
+static void
+phoc_output_damage_init (PhocOutputDamage *damage, bool whole)
+{
+  damage->whole = whole;
+  damage->schedule_frame = false;
+  pixman_region32_init (&damage->damage);
+  pixman_region32_init (&damage->surface_damage);
+}
+
+/*
+ * Add the collected damage to the damage ring (which clips it to the
+ * output) and schedule a frame if needed.
+ */
+static void
+phoc_output_damage_flush (PhocOutput *self, PhocOutputDamage *damage)
+{
+  if (pixman_region32_not_empty (&damage->damage) &&
+      wlr_damage_ring_add (&self->damage_ring, &damage->damage))
+    damage->schedule_frame = true;
+
+  if (damage->schedule_frame)
+    wlr_output_schedule_frame (self->wlr_output);
+
+  pixman_region32_fini (&damage->surface_damage);
+  pixman_region32_fini (&damage->damage);
 }
 
+
 static void
 damage_surface_iterator (PhocOutput *self, struct wlr_surface *surface, struct wlr_box *_box,
                          float scale, void *data)
 {
-  bool *whole = data;
+  PhocOutputDamage *damage = data;
+  pixman_region32_t *surface_damage = &damage->surface_damage;
 
   struct wlr_box box = *_box;
 
   phoc_utils_scale_box (&box, scale);
   phoc_utils_scale_box (&box, self->wlr_output->scale);
 
-  pixman_region32_t damage;
-  pixman_region32_init (&damage);
-  wlr_surface_get_effective_damage (surface, &damage);
-  wlr_region_scale (&damage, &damage, scale);
-  wlr_region_scale (&damage, &damage, self->wlr_output->scale);
-  if (ceil (self->wlr_output->scale) > surface->current.scale) {
-    // When scaling up a surface, it'll become blurry so we need to
-    // expand the damage region
-    wlr_region_expand (&damage, &damage, ceil (self->wlr_output->scale) - surface->current.scale);
-  }
-
-  pixman_region32_translate (&damage, box.x, box.y);
-  if (wlr_damage_ring_add (&self->damage_ring, &damage))
-    wlr_output_schedule_frame (self->wlr_output);
-  pixman_region32_fini (&damage);
+  wlr_surface_get_effective_damage (surface, surface_damage);
+  if (pixman_region32_not_empty (surface_damage)) {
+    wlr_region_scale (surface_damage, surface_damage, scale);
+    wlr_region_scale (surface_damage, surface_damage, self->wlr_output->scale);
+    if (ceil (self->wlr_output->scale) > surface->current.scale) {
+      // When scaling up a surface, it'll become blurry so we need to
+      // expand the damage region
+      wlr_region_expand (surface_damage, surface_damage,
+                         ceil (self->wlr_output->scale) - surface->current.scale);
+    }
 
-  if (*whole) {
-    if (wlr_damage_ring_add_box (&self->damage_ring, &box))
-      wlr_output_schedule_frame (self->wlr_output);
+    pixman_region32_translate (surface_damage, box.x, box.y);
+    pixman_region32_union (&damage->damage, &damage->damage, surface_damage);
   }
 
+  if (damage->whole)
+    pixman_region32_union_rect (&damage->damage, &damage->damage,
+                                box.x, box.y, box.width, box.height);
+
   if (!wl_list_empty (&surface->current.frame_callback_list))
-    wlr_output_schedule_frame (self->wlr_output);
+    damage->schedule_frame = true;
 }
 
 
 static void
-damage_whole_view (PhocOutput *self, PhocView  *view)
+damage_whole_view (PhocOutput *self, PhocView  *view, PhocOutputDamage *damage)
 {
   GSList *blings;
   struct wlr_box box;
@@ -1556,47 +2362,95 @@ damage_whole_view (PhocOutput *self, PhocView  *view)
     box.y -= self->ly;
     phoc_utils_scale_box (&box, self->wlr_output->scale);
 
-    if (wlr_damage_ring_add_box (&self->damage_ring, &box))
-      wlr_output_schedule_frame (self->wlr_output);
+    pixman_region32_union_rect (&damage->damage, &damage->damage,
+                                box.x, box.y, box.width, box.height);
   }
 }
 
-
 /**
  * phoc_output_damage_from_view:
  * @self: The output to add damage to
  * @view: The view providing the damage
- * @whole: Whether
+ * @view_damage: The damage collected from the view's surfaces
  *
- * Adds a [type@PhocView]'s damage to the damaged area of @self. If
- * @whole is %TRUE the whole view is damaged (including any window
- * decorations if they exist). If @whole is %FALSE only buffer damage
- * is taken into account.
+ * Adds a [type@PhocView]'s collected damage to the damaged area of
+ * @self. If the damage was collected for the whole view, any window
+ * decorations are damaged too. Views not on @self are skipped based on
+ * the bounds collected along with the damage.
  * Also schedules a new frame.
  */
 void
-phoc_output_damage_from_view (PhocOutput *self, PhocView  *view, bool whole)
+phoc_output_damage_from_view (PhocOutput *self, PhocView *view, PhocViewDamage *view_damage)
 {
+  struct wlr_box bounds, intersection, output_box = { 0 };
+  PhocOutputDamage damage;
+  float scale;
+  int width, height;
+
   if (!phoc_view_accept_damage (self, view)) {
     return;
   }
 
-  if (whole)
-    damage_whole_view (self, view);
+  phoc_output_damage_init (&damage, view_damage->whole);
+
+  if (view_damage->whole)
+    damage_whole_view (self, view, &damage);
+
+  /* Same coordinate space as phoc_output_view_for_each_surface() */
+  scale = phoc_view_get_scale (view);
+  bounds = view_damage->bounds;
+  bounds.x += view->box.x - self->lx;
+  bounds.y += view->box.y - self->ly;
+  wlr_output_effective_resolution (self->wlr_output, &output_box.width, &output_box.height);
+  phoc_utils_scale_box (&output_box, 1 / scale);
+
+  if (wlr_box_intersection (&intersection, &output_box, &bounds)) {
+    pixman_region32_t *region = &damage.surface_damage;
+
+    pixman_region32_copy (region, &view_damage->damage);
+    if (pixman_region32_not_empty (region)) {
+      pixman_region32_translate (region, view->box.x - self->lx, view->box.y - self->ly);
+      wlr_region_scale (region, region, scale);
+      wlr_region_scale (region, region, self->wlr_output->scale);
+      if (ceil (self->wlr_output->scale) > view_damage->min_buffer_scale) {
+        // When scaling up a surface, it'll become blurry so we need to
+        // expand the damage region
+        wlr_region_expand (region, region,
+                           ceil (self->wlr_output->scale) - view_damage->min_buffer_scale);
+      }
+
+      wlr_output_transformed_resolution (self->wlr_output, &width, &height);
+      pixman_region32_intersect_rect (region, region, 0, 0, width, height);
+      pixman_region32_union (&damage.damage, &damage.damage, region);
+      refresh_policy_content_update (self);
+    }
+
+    damage.schedule_frame = view_damage->frame_callbacks;
+  }
+
+  phoc_output_damage_flush (self, &damage);
+}
+
+
+static void
+damage_surface (PhocOutput *self, struct wlr_surface *surface, double ox, double oy, bool whole)
+{
+  PhocOutputDamage damage;
 
-  phoc_output_view_for_each_surface (self, view, damage_surface_iterator, &whole);
+  phoc_output_damage_init (&damage, whole);
+  phoc_output_surface_for_each_surface (self, surface, ox, oy, damage_surface_iterator, &damage);
+  phoc_output_damage_flush (self, &damage);
 }
 
+
 void
 phoc_output_damage_whole_drag_icon (PhocOutput *self, PhocDragIcon *icon)
 {
-  bool whole = true;
-
-  phoc_output_surface_for_each_surface (self,
-                                        phoc_drag_icon_get_wlr_surface (icon),
-                                        phoc_drag_icon_get_x (icon),
-                                        phoc_drag_icon_get_y (icon),
-                                        damage_surface_iterator, &whole);
+  damage_surface (self,
+                  phoc_drag_icon_get_wlr_surface (icon),
+                  phoc_drag_icon_get_x (icon),
+                  phoc_drag_icon_get_y (icon),
+                  true);
 }
 
 void
@@ -1605,10 +2459,7 @@ phoc_output_damage_whole_surface (PhocOutput         *self,
                                   double              ox,
                                   double              oy)
 {
-  bool whole = true;
-
-  phoc_output_surface_for_each_surface (self, surface, ox, oy,
-                                        damage_surface_iterator, &whole);
+  damage_surface (self, surface, ox, oy, true);
 }
 
 void
@@ -1617,87 +2468,282 @@ phoc_output_damage_from_surface (PhocOutput         *self,
                                  double              ox,
                                  double              oy)
 {
-  bool whole = false;
-
-  phoc_output_surface_for_each_surface (self, surface, ox, oy,
-                                        damage_surface_iterator, &whole);
+  damage_surface (self, surface, ox, oy, false);
 }
 
 
+typedef struct {
+  struct wlr_output       *wlr_output;
+  PhocOutput              *output;
+  struct wlr_output_state  pending;
+  struct wlr_output_state  restore;
+  gboolean                 committed;
+} PhocOutputConfigHead;
+
+
 static void
-output_manager_apply_config (PhocDesktop                        *desktop,
-                             struct wlr_output_configuration_v1 *config,
-                             gboolean                            test_only)
+phoc_output_config_head_clear (PhocOutputConfigHead *head)
+{
+  wlr_output_state_finish (&head->pending);
+  wlr_output_state_finish (&head->restore);
+}
+
+/*
+ * Fill in the state for a configuration head. Only what differs from
+ * the output's current state is set so unchanged outputs aren't
+ * committed at all. Also record how to restore the current state.
+ */
+static void
+build_head_states (struct wlr_output_configuration_head_v1 *config_head,
+                   PhocOutputConfigHead                    *head)
+{
+  struct wlr_output *wlr_output = config_head->state.output;
+  struct wlr_output_state *pending = &head->pending;
+  struct wlr_output_state *restore = &head->restore;
+  double scale = adjust_frac_scale (config_head->state.scale);
+
+  head->wlr_output = wlr_output;
+  head->output = PHOC_OUTPUT (wlr_output->data);
+  wlr_output_state_init (pending);
+  wlr_output_state_init (restore);
+
+  if (!config_head->state.enabled) {
+    if (wlr_output->enabled) {
+      wlr_output_state_set_enabled (pending, false);
+      wlr_output_state_set_enabled (restore, true);
+    }
+    return;
+  }
+
+  if (!wlr_output->enabled) {
+    wlr_output_state_set_enabled (pending, true);
+    wlr_output_state_set_enabled (restore, false);
+  }
+
+  if (config_head->state.mode != NULL) {
+    if (config_head->state.mode != wlr_output->current_mode)
+      wlr_output_state_set_mode (pending, config_head->state.mode);
+  } else if (config_head->state.custom_mode.width != wlr_output->width ||
+             config_head->state.custom_mode.height != wlr_output->height ||
+             config_head->state.custom_mode.refresh != wlr_output->refresh) {
+    wlr_output_state_set_custom_mode (pending,
+                                      config_head->state.custom_mode.width,
+                                      config_head->state.custom_mode.height,
+                                      config_head->state.custom_mode.refresh);
+  }
+
+  if (pending->committed & WLR_OUTPUT_STATE_MODE) {
+    if (wlr_output->current_mode) {
+      wlr_output_state_set_mode (restore, wlr_output->current_mode);
+    } else {
+      wlr_output_state_set_custom_mode (restore, wlr_output->width, wlr_output->height,
+                                        wlr_output->refresh);
+    }
+  }
 
+  if (config_head->state.transform != wlr_output->transform) {
+    wlr_output_state_set_transform (pending, config_head->state.transform);
+    wlr_output_state_set_transform (restore, wlr_output->transform);
+  }
+
+  if ((float)scale != wlr_output->scale) {
+    wlr_output_state_set_scale (pending, scale);
+    wlr_output_state_set_scale (restore, wlr_output->scale);
+  }
+}
+
+
+static char *
+serialize_config (struct wlr_output_configuration_v1 *config)
 {
   struct wlr_output_configuration_head_v1 *config_head;
-  gboolean ok = TRUE;
+  GString *str = g_string_new (NULL);
 
-  /* First disable outputs we need to disable */
   wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
-    struct wlr_output_state pending;
+    struct wlr_output_head_v1_state *state = &config_head->state;
+
+    g_string_append_printf (str, "%s:%d", state->output->name, state->enabled);
+    if (!state->enabled) {
+      g_string_append_c (str, ';');
+      continue;
+    }
+
+    if (state->mode) {
+      g_string_append_printf (str, ":%dx%d@%d", state->mode->width, state->mode->height,
+                              state->mode->refresh);
+    } else {
+      g_string_append_printf (str, ":c%dx%d@%d", state->custom_mode.width,
+                              state->custom_mode.height, state->custom_mode.refresh);
+    }
+    g_string_append_printf (str, ":%d:%f;", state->transform, state->scale);
+  }
+
+  return g_string_free (str, FALSE);
+}
+
+
+static gboolean
+is_disabling_head (const PhocOutputConfigHead *head)
+{
+  return (head->pending.committed & WLR_OUTPUT_STATE_ENABLED) && !head->pending.enabled;
+}
+
+/*
+ * Each head is tested against the current state of the other outputs.
+ * A head might only be rejected because it needs resources (e.g. a
+ * CRTC) that get freed by disabling other outputs in the same
+ * configuration. Such a rejection isn't final, @uncertain is set
+ * instead and only the ordered commit can tell.
+ */
+static gboolean
+test_heads (GArray *heads, gboolean *uncertain)
+{
+  gboolean has_disables = FALSE;
+
+  *uncertain = FALSE;
+
+  for (guint i = 0; i < heads->len; i++)
+    has_disables |= is_disabling_head (&g_array_index (heads, PhocOutputConfigHead, i));
+
+  for (guint i = 0; i < heads->len; i++) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
 
-    wlr_output_state_init (&pending);
-    if (config_head->state.enabled)
+    if (head->pending.committed == 0)
       continue;
 
-    if (!wlr_output->enabled)
+    if (wlr_output_test_state (head->wlr_output, &head->pending))
       continue;
 
-    wlr_output_state_set_enabled (&pending, false);
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_remove (desktop->layout, wlr_output);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
+    if (has_disables && !is_disabling_head (head)) {
+      g_debug ("Output '%s' rejected new configuration, might need disabled outputs' resources",
+               head->wlr_output->name);
+      *uncertain = TRUE;
+      continue;
     }
-    wlr_output_state_finish (&pending);
+
+    g_debug ("Output '%s' rejected new configuration", head->wlr_output->name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+commit_heads (GArray *heads)
+{
+  for (guint i = 0; i < heads->len; i++) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
+
+    if (head->pending.committed == 0)
+      continue;
+
+    if (!wlr_output_commit_state (head->wlr_output, &head->pending)) {
+      g_warning ("Failed to commit configuration of output '%s'", head->wlr_output->name);
+      return FALSE;
+    }
+    head->committed = TRUE;
+  }
+
+  return TRUE;
+}
+
+
+static void
+rollback_heads (GArray *heads)
+{
+  /* Reverse order so enabled outputs get disabled again before others get re-enabled */
+  for (int i = heads->len - 1; i >= 0; i--) {
+    PhocOutputConfigHead *head = &g_array_index (heads, PhocOutputConfigHead, i);
+
+    if (!head->committed)
+      continue;
+
+    if (!wlr_output_commit_state (head->wlr_output, &head->restore))
+      g_warning ("Failed to restore configuration of output '%s'", head->wlr_output->name);
+  }
+}
+
+/* Disabled outputs first to free up resources for the enabled ones */
+static gint
+compare_heads (gconstpointer a, gconstpointer b)
+{
+  return is_disabling_head (b) - is_disabling_head (a);
+}
+
+
+static void
+output_manager_apply_config (PhocDesktop                        *desktop,
+                             struct wlr_output_configuration_v1 *config,
+                             gboolean                            test_only)
+
+{
+  struct wlr_output_configuration_head_v1 *config_head;
+  g_autoptr (GArray) heads = NULL;
+  g_autofree char *key = NULL;
+  gboolean ok, uncertain = FALSE;
+  gpointer cached;
+
+  /* Outputs whose configuration doesn't change aren't touched at all */
+  heads = g_array_new (FALSE, TRUE, sizeof (PhocOutputConfigHead));
+  g_array_set_clear_func (heads, (GDestroyNotify)phoc_output_config_head_clear);
+  wl_list_for_each (config_head, &config->heads, link) {
+    g_array_set_size (heads, heads->len + 1);
+    build_head_states (config_head,
+                       &g_array_index (heads, PhocOutputConfigHead, heads->len - 1));
+  }
+  g_array_sort (heads, compare_heads);
+
+  /* Validate all outputs before changing any of them. Results stay valid
+   * until the current configuration changes */
+  key = serialize_config (config);
+  if (g_hash_table_lookup_extended (desktop->output_config_tests, key, NULL, &cached)) {
+    ok = GPOINTER_TO_INT (cached);
+  } else {
+    ok = test_heads (heads, &uncertain);
+    if (!uncertain) {
+      g_hash_table_insert (desktop->output_config_tests, g_steal_pointer (&key),
+                           GINT_TO_POINTER (ok));
+    }
+  }
+
+  /* Uncertain results pass test requests, only the commit can tell */
+  if (!ok || test_only)
+    goto out;
+
+  /* Apply the new layout along with the commits so each head gets a
+   * single modeset. Disables go first, so outputs that failed isolated
+   * testing get the resources freed by them. */
+  ok = commit_heads (heads);
+  if (!ok) {
+    rollback_heads (heads);
+    goto out;
   }
 
-  /* Then enable outputs that need to */
   wl_list_for_each (config_head, &config->heads, link) {
     struct wlr_output *wlr_output = config_head->state.output;
     PhocOutput *output = PHOC_OUTPUT (wlr_output->data);
-    struct wlr_output_state pending;
     struct wlr_box output_box;
 
-    if (!config_head->state.enabled)
+    if (!config_head->state.enabled) {
+      wlr_output_layout_remove (desktop->layout, wlr_output);
       continue;
-
-    wlr_output_state_init (&pending);
-    wlr_output_state_set_enabled (&pending, true);
-    if (config_head->state.mode != NULL) {
-      wlr_output_state_set_mode (&pending, config_head->state.mode);
-    } else {
-      wlr_output_state_set_custom_mode (&pending,
-                                        config_head->state.custom_mode.width,
-                                        config_head->state.custom_mode.height,
-                                        config_head->state.custom_mode.refresh);
     }
-    wlr_output_state_set_transform (&pending, config_head->state.transform);
-    wlr_output_state_set_scale (&pending, adjust_frac_scale (config_head->state.scale));
 
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_add (desktop->layout,
-                             wlr_output,
-                             config_head->state.x,
-                             config_head->state.y);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
-
-      if (output->fullscreen_view)
-        phoc_view_set_fullscreen (output->fullscreen_view, true, output);
-
-      wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
-      output->lx = output_box.x;
-      output->ly = output_box.y;
-    }
+    wlr_output_layout_add (desktop->layout,
+                           wlr_output,
+                           config_head->state.x,
+                           config_head->state.y);
 
-    wlr_output_state_finish (&pending);
+    if (output->fullscreen_view)
+      phoc_view_set_fullscreen (output->fullscreen_view, true, output);
+
+    wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
+    output->lx = output_box.x;
+    output->ly = output_box.y;
   }
 
+ out:
   if (ok)
     wlr_output_configuration_v1_send_succeeded (config);
   else
@@ -1867,8 +2913,10 @@ phoc_output_add_frame_callback  (PhocOutput        *self,
     .id = priv->frame_callback_next_id,
   };
 
+  /* Animations run at the full refresh rate */
+  refresh_policy_mark_busy (self);
+
   if (priv->frame_callbacks == NULL) {
-    priv->last_frame_us = g_get_monotonic_time ();
     /* No other frame callbacks so need to schedule a frame to keep
      * frame clock ticking */
     wlr_output_schedule_frame (self->wlr_output);
@@ -1933,6 +2981,22 @@ phoc_output_remove_frame_callbacks_by_animatable (PhocOutput *self, PhocAnimatab
   } while (found);
 }
 
+/**
+ * phoc_output_notify_activity:
+ * @self: The output
+ *
+ * Notify the output about user activity like input events. If the
+ * output lowered its refresh rate it switches back to the configured
+ * one.
+ */
+void
+phoc_output_notify_activity (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  refresh_policy_mark_busy (self);
+}
+
 /**
  * phoc_output_has_frame_callbacks:
  * @self: The output to look at
@@ -1950,6 +3014,29 @@ phoc_output_has_frame_callbacks (PhocOutput *self)
   return !!priv->frame_callbacks;
 }
 
+/**
+ * phoc_output_has_overlays:
+ * @self: The output
+ *
+ * Whether anything gets drawn on top of the output's scene at the end
+ * of the render pass like the shield or the cutouts overlay.
+ *
+ * Returns: %TRUE if there are overlays to render
+ */
+gboolean
+phoc_output_has_overlays (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->cutouts_tiles)
+    return TRUE;
+
+  return priv->shield && phoc_output_shield_is_rendering (priv->shield);
+}
+
 /**
  * phoc_output_lower_shield:
  * @self: The output to lower the shield for
@@ -2231,3 +3318,104 @@ phoc_output_get_wlr_output (PhocOutput *self)
 
   return self->wlr_output;
 }
+
+
+/**
+ * phoc_output_get_scanout_status:
+ * @self: The output
+ *
+ * Returns: Whether the last frame was scanned out directly and if not
+ *   why direct scanout was rejected.
+ */
+PhocOutputScanout
+phoc_output_get_scanout_status (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->scanout_status;
+}
+
+
+/**
+ * phoc_output_get_frame_timings:
+ * @self: The output
+ *
+ * Get the timings of the most recent frames. These are only recorded
+ * when the `frame-timings` debug flag is set.
+ *
+ * Returns: (transfer none)(nullable): The frame timings
+ */
+PhocFrameTimings *
+phoc_output_get_frame_timings (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->frame_timings;
+}
+
+/**
+ * phoc_output_get_repaint_stats:
+ * @self: The output
+ * @stats: (out): The repaint statistics
+ *
+ * Get statistics about how the output's repaints got scheduled.
+ */
+void
+phoc_output_get_repaint_stats (PhocOutput *self, PhocRepaintSchedulerStats *stats)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  phoc_repaint_scheduler_get_stats (priv->repaint_scheduler, stats);
+}
+
+/**
+ * phoc_output_get_n_offloaded:
+ * @self: The output
+ *
+ * Returns: The number of surfaces the last frame put on output layers
+ *   instead of compositing them.
+ */
+guint
+phoc_output_get_n_offloaded (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->n_offloaded;
+}
+
+/**
+ * phoc_output_set_layers_test_func:
+ * @self: The output
+ * @func: (nullable): The function to test states with output layers
+ * @user_data: User data passed to @func
+ *
+ * Overrides how states using output layers are tested. This allows
+ * to emulate hardware plane support in tests. Pass %NULL to use the
+ * backend's test again.
+ */
+void
+phoc_output_set_layers_test_func (PhocOutput         *self,
+                                  PhocOutputTestFunc  func,
+                                  gpointer            user_data)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  priv->layers_test_func = func;
+  priv->layers_test_data = user_data;
+  priv->n_rejected = 0;
+}
@@ -2,7 +2,9 @@
 
 #include "animatable.h"
 #include "drag-icon.h"
+#include "frame-timings.h"
 #include "render.h"
+#include "repaint-scheduler.h"
 #include "view.h"
 
 #include <gio/gio.h>
@@ -10,6 +12,7 @@
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/box.h>
 
@@ -22,6 +25,7 @@ G_DECLARE_FINAL_TYPE (PhocOutput, phoc_output, PHOC, OUTPUT, GObject);
 typedef struct _PhocDesktop PhocDesktop;
 typedef struct _PhocInput PhocInput;
 typedef struct _PhocLayerSurface PhocLayerSurface;
+typedef struct _PhocViewDamage PhocViewDamage;
 
 /**
  * PhocOutputScaleFilter:
@@ -32,6 +36,37 @@ typedef enum _PhocOutputScaleFilter {
   PHOC_OUTPUT_SCALE_FILTER_NEAREST,
 } PhocOutputScaleFilter;
 
+/**
+ * PhocOutputScanout:
+ * @PHOC_OUTPUT_SCANOUT_OK: The surface's buffer is scanned out directly
+ * @PHOC_OUTPUT_SCANOUT_DEBUG: Debug overlays need to be rendered
+ * @PHOC_OUTPUT_SCANOUT_RENDER_END: Something renders on top of the scene
+ * @PHOC_OUTPUT_SCANOUT_NO_SURFACE: There's no visible surface
+ * @PHOC_OUTPUT_SCANOUT_NO_BUFFER: The surface has no buffer
+ * @PHOC_OUTPUT_SCANOUT_TRANSLUCENT: The surface isn't opaque but there's
+ *   content behind it
+ * @PHOC_OUTPUT_SCANOUT_NOT_COVERING: The surface doesn't cover the whole output
+ * @PHOC_OUTPUT_SCANOUT_SCALE_MISMATCH: The buffer's scale, transform or size
+ *   doesn't match the output's
+ * @PHOC_OUTPUT_SCANOUT_NOT_ALLOWED: The output doesn't allow direct scanout
+ *   (e.g. due to software cursors or screen capture)
+ * @PHOC_OUTPUT_SCANOUT_TEST_FAILED: The backend rejected the buffer
+ *
+ * Whether direct scanout succeeded and if not why it was rejected.
+ */
+typedef enum _PhocOutputScanout {
+  PHOC_OUTPUT_SCANOUT_OK = 0,
+  PHOC_OUTPUT_SCANOUT_DEBUG,
+  PHOC_OUTPUT_SCANOUT_RENDER_END,
+  PHOC_OUTPUT_SCANOUT_NO_SURFACE,
+  PHOC_OUTPUT_SCANOUT_NO_BUFFER,
+  PHOC_OUTPUT_SCANOUT_TRANSLUCENT,
+  PHOC_OUTPUT_SCANOUT_NOT_COVERING,
+  PHOC_OUTPUT_SCANOUT_SCALE_MISMATCH,
+  PHOC_OUTPUT_SCANOUT_NOT_ALLOWED,
+  PHOC_OUTPUT_SCANOUT_TEST_FAILED,
+} PhocOutputScanout;
+
 /**
  * PhocOutput:
  *
@@ -54,6 +89,9 @@ struct _PhocOutput {
   GList                    *debug_touch_points;
 
   struct wlr_box            usable_area;
+  /* Usable area before and after each layer's exclusive surfaces got arranged */
+  struct wlr_box            layer_area_in[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
+  struct wlr_box            layer_area_out[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
   int                       lx, ly;
 
   struct wl_listener        commit;
@@ -72,6 +110,20 @@ typedef void (*PhocSurfaceIterator)(PhocOutput         *self,
                                     struct wlr_box     *box,
                                     float               scale,
                                     void               *user_data);
+/**
+ * PhocOutputTestFunc:
+ * @self: The output
+ * @state: The state to test
+ * @user_data: User data
+ *
+ * Checks whether the output can apply @state. Used to emulate output
+ * layer support in tests.
+ *
+ * Returns: %TRUE if the state can be applied
+ */
+typedef gboolean (*PhocOutputTestFunc)(PhocOutput              *self,
+                                       struct wlr_output_state *state,
+                                       gpointer                 user_data);
 void        phoc_output_xdg_surface_for_each_surface (PhocOutput *self,
                                                       struct wlr_xdg_surface *xdg_surface,
                                                       double ox,
@@ -119,7 +171,10 @@ void        phoc_output_handle_gamma_control_set_gamma (struct wl_listener *list
 struct wlr_output *
             phoc_output_get_wlr_output (PhocOutput *output);
 void        phoc_output_damage_whole (PhocOutput *output);
-void        phoc_output_damage_from_view (PhocOutput *self, PhocView *view, bool whole);
+void        phoc_output_damage_from_view (PhocOutput     *self,
+                                          PhocView       *view,
+                                          PhocViewDamage *view_damage);
+gboolean    phoc_output_view_is_occluded (PhocOutput *self, PhocView *view);
 void        phoc_output_damage_whole_drag_icon (PhocOutput   *self,
                                                 PhocDragIcon *icon);
 void        phoc_output_damage_from_surface (PhocOutput *self, struct wlr_surface *surface,
@@ -148,7 +203,9 @@ void       phoc_output_remove_frame_callback (PhocOutput        *self,
 void       phoc_output_remove_frame_callbacks_by_animatable (PhocOutput     *self,
                                                              PhocAnimatable *animatable);
 bool       phoc_output_has_frame_callbacks   (PhocOutput        *self);
+void       phoc_output_notify_activity       (PhocOutput        *self);
 
+gboolean   phoc_output_has_overlays          (PhocOutput *self);
 void       phoc_output_lower_shield          (PhocOutput *self);
 void       phoc_output_raise_shield          (PhocOutput *self);
 float      phoc_output_get_scale             (PhocOutput *self);
@@ -158,5 +215,15 @@ void       phoc_output_transform_box         (PhocOutput *self, struct wlr_box *
 
 enum wlr_scale_filter_mode
            phoc_output_get_texture_filter_mode (PhocOutput *self);
+PhocOutputScanout
+           phoc_output_get_scanout_status    (PhocOutput *self);
+guint      phoc_output_get_n_offloaded       (PhocOutput *self);
+PhocFrameTimings *
+           phoc_output_get_frame_timings     (PhocOutput *self);
+void       phoc_output_get_repaint_stats     (PhocOutput                *self,
+                                              PhocRepaintSchedulerStats *stats);
+void       phoc_output_set_layers_test_func  (PhocOutput         *self,
+                                              PhocOutputTestFunc  func,
+                                              gpointer            user_data);
 
 G_END_DECLS
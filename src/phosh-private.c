@@ -13,15 +13,19 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/config.h>
 #include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_matrix.h>
+#include <wlr/util/box.h>
+#include <wlr/util/region.h>
 #include <phosh-private-protocol.h>
 #include <wlr-screencopy-unstable-v1-protocol.h>
 #include "server.h"
 #include "desktop.h"
+#include "output.h"
 #include "render.h"
 #include "utils.h"
 
@@ -58,6 +62,12 @@ struct _PhocPhoshPrivate {
   guint last_action_id;
   GList *startup_trackers;
   PhocPhoshPrivateShellState state;
+  GHashTable *thumbnails; /* PhocView → PhocThumbnail */
+  GQueue *render_queue;   /* PhocPhoshPrivateScreencopyFrame to render */
+  guint render_id;
+  GQueue *readback_queue; /* PhocPhoshPrivateScreencopyFrame waiting for the GPU */
+  guint readback_id;
+  PhocPhoshPrivateThumbnailStats stats;
 };
 G_DEFINE_TYPE (PhocPhoshPrivate, phoc_phosh_private, G_TYPE_OBJECT)
 
@@ -79,8 +89,30 @@ typedef struct {
   struct wlr_buffer *buffer;
 
   PhocView *view;
+  gboolean with_damage;
+  struct _PhocThumbnail *thumbnail; /* set while waiting for damage or rendering */
+  PhocRenderReadback *readback;     /* set while waiting for the GPU */
+  pixman_region32_t damage;         /* the damage the read back is for */
+  gint64 stall_us;
 } PhocPhoshPrivateScreencopyFrame;
 
+/*
+ * The last thumbnail sent for a view. Only the parts the view's
+ * surfaces damaged since are rendered and read back again.
+ */
+typedef struct _PhocThumbnail {
+  PhocPhoshPrivate  *phosh;
+  PhocView          *view;
+
+  uint32_t           width;
+  uint32_t           height;
+  uint32_t           stride;
+  guint8            *pixels;  /* NULL until rendered once */
+  pixman_region32_t  damage;  /* thumbnail coordinates */
+
+  GSList            *pending; /* PhocPhoshPrivateScreencopyFrame waiting for damage */
+} PhocThumbnail;
+
 typedef struct {
   struct wl_resource *resource;
   PhocPhoshPrivate   *phosh;
@@ -92,6 +124,9 @@ static PhocPhoshPrivateScreencopyFrame *phoc_phosh_private_screencopy_frame_from
 static PhocPhoshPrivateStartupTracker *phoc_phosh_private_startup_tracker_from_resource(struct wl_resource *resource);
 
 #define PHOSH_PRIVATE_VERSION 7
+/* How often to check whether the GPU finished a thumbnail read back
+ * if the view isn't on any output */
+#define PHOC_PHOSH_PRIVATE_READBACK_POLL_MS 16
 
 
 static void
@@ -137,16 +172,42 @@ handle_get_xdg_switcher (struct wl_client   *client,
                           "Use wlr-toplevel-management protocol instead");
 }
 
+static PhocKeybindings *
+get_keybindings (void)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+
+  return config->keybindings;
+}
+
+
+static void
+key_to_combo (gint64 key, PhocKeyCombo *combo)
+{
+  combo->modifiers = key >> 32;
+  combo->keysym = key & 0xffffffff;
+}
+
+
 static void
 phoc_phosh_private_keyboard_event_destroy (PhocPhoshPrivateKeyboardEventData *kbevent)
 {
   PhocPhoshPrivate *phosh;
+  GHashTableIter iter;
+  gpointer key;
 
   if (kbevent == NULL)
     return;
 
   g_debug ("Destroying private_keyboard_event %p (res %p)", kbevent, kbevent->resource);
   phosh = kbevent->phosh;
+  g_hash_table_iter_init (&iter, kbevent->subscribed_accelerators);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    PhocKeyCombo combo;
+
+    key_to_combo (*(gint64 *)key, &combo);
+    phoc_keybindings_ungrab_accelerator (get_keybindings (), &combo, kbevent);
+  }
   g_hash_table_remove_all (kbevent->subscribed_accelerators);
   g_hash_table_unref (kbevent->subscribed_accelerators);
   wl_resource_set_user_data (kbevent->resource, NULL);
@@ -162,34 +223,6 @@ phoc_phosh_private_keyboard_event_handle_resource_destroy (struct wl_resource *r
   phoc_phosh_private_keyboard_event_destroy (kbevent);
 }
 
-static bool
-phoc_phosh_private_keyboard_event_accelerator_is_registered (PhocKeyCombo                      *combo,
-                                                             PhocPhoshPrivateKeyboardEventData *kbevent)
-{
-  gint64 key = ((gint64) combo->modifiers << 32) | combo->keysym;
-  gpointer ret = g_hash_table_lookup (kbevent->subscribed_accelerators, &key);
-  g_debug ("Accelerator is registered: Lookup -> %p", ret);
-  return (ret != NULL);
-}
-
-static bool
-phoc_phosh_private_accelerator_already_subscribed (PhocKeyCombo *combo)
-{
-  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
-  PhocPhoshPrivate *phosh = phoc_desktop_get_phosh_private (desktop);
-  GList *l;
-  PhocPhoshPrivateKeyboardEventData *kbevent;
-
-  for (l = phosh->keyboard_events; l != NULL; l = l->next) {
-    kbevent = (PhocPhoshPrivateKeyboardEventData *)l->data;
-    if (phoc_phosh_private_keyboard_event_accelerator_is_registered (combo, kbevent))
-      return true;
-  }
-
-  return false;
-}
-
-
 static bool
 keysym_is_subscribeable (PhocKeyCombo *combo)
 {
@@ -244,7 +277,7 @@ phoc_phosh_private_keyboard_event_grab_accelerator_request (struct wl_client   *
     return;
   }
 
-  if (phoc_phosh_private_accelerator_already_subscribed (combo)) {
+  if (phoc_keybindings_lookup_grab (get_keybindings (), combo, NULL)) {
     g_debug ("Accelerator %s already subscribed to!", accelerator);
 
     phosh_private_keyboard_event_send_grab_failed_event (resource,
@@ -280,6 +313,8 @@ phoc_phosh_private_keyboard_event_grab_accelerator_request (struct wl_client   *
   /* subscribed accelerators of kbevent */
   g_hash_table_insert (kbevent->subscribed_accelerators,
                        new_key, GUINT_TO_POINTER (new_action_id));
+  /* and the index used when keys get pressed */
+  phoc_keybindings_grab_accelerator (get_keybindings (), combo, kbevent, new_action_id);
 
   phosh_private_keyboard_event_send_grab_success_event (resource,
                                                         accelerator,
@@ -310,7 +345,11 @@ phoc_phosh_private_keyboard_event_ungrab_accelerator_request (struct wl_client *
   }
 
   if (found) {
-    g_hash_table_remove (kbevent->subscribed_accelerators, key);
+    PhocKeyCombo combo;
+
+    key_to_combo (*(gint64 *)found, &combo);
+    phoc_keybindings_ungrab_accelerator (get_keybindings (), &combo, kbevent);
+    g_hash_table_remove (kbevent->subscribed_accelerators, found);
     phosh_private_keyboard_event_send_ungrab_success_event (resource,
                                                             action_id);
 
@@ -390,6 +429,15 @@ phosh_private_screencopy_frame_handle_resource_destroy (struct wl_resource *reso
   if (frame->view)
     g_signal_handlers_disconnect_by_data (frame->view, frame);
 
+  if (frame->thumbnail) {
+    frame->thumbnail->pending = g_slist_remove (frame->thumbnail->pending, frame);
+    g_queue_remove (frame->thumbnail->phosh->render_queue, frame);
+    g_queue_remove (frame->thumbnail->phosh->readback_queue, frame);
+    wlr_buffer_unlock (frame->buffer);
+  }
+
+  g_clear_pointer (&frame->readback, phoc_render_readback_free);
+  pixman_region32_fini (&frame->damage);
   free (frame);
 }
 
@@ -405,13 +453,389 @@ on_surface_destroy (PhocView *view, PhocPhoshPrivateScreencopyFrame *frame)
 
 
 static void
-thumbnail_frame_handle_copy (struct wl_client   *wl_client,
-                             struct wl_resource *frame_resource,
-                             struct wl_resource *buffer_resource)
+send_ready (PhocPhoshPrivateScreencopyFrame *frame)
 {
-  PhocServer *server = phoc_server_get_default ();
-  PhocRenderer *self = phoc_server_get_renderer (server);
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
+  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
+  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+}
+
+
+static void
+thumbnail_reset (PhocThumbnail *thumbnail)
+{
+  g_clear_pointer (&thumbnail->pixels, g_free);
+  pixman_region32_clear (&thumbnail->damage);
+}
+
+
+static gboolean
+thumbnail_copy_pixels (PhocThumbnail *thumbnail, struct wlr_buffer *buffer, gboolean to_buffer)
+{
+  void *data;
+  uint32_t format;
+  size_t stride;
+  size_t size = thumbnail->stride * thumbnail->height;
+  uint32_t flags = to_buffer ? WLR_BUFFER_DATA_PTR_ACCESS_WRITE : WLR_BUFFER_DATA_PTR_ACCESS_READ;
+
+  if (!wlr_buffer_begin_data_ptr_access (buffer, flags, &data, &format, &stride))
+    return FALSE;
+
+  g_assert (stride == thumbnail->stride);
+  if (to_buffer) {
+    memcpy (data, thumbnail->pixels, size);
+  } else {
+    if (thumbnail->pixels == NULL)
+      thumbnail->pixels = g_malloc (size);
+    memcpy (thumbnail->pixels, data, size);
+  }
+
+  wlr_buffer_end_data_ptr_access (buffer);
+  return TRUE;
+}
+
+static void
+send_frame (PhocPhoshPrivateScreencopyFrame *frame, pixman_region32_t *damage)
+{
+  zwlr_screencopy_frame_v1_send_flags (frame->resource, 0);
+
+  if (frame->with_damage) {
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles (damage, &nrects);
+
+    for (int i = 0; i < nrects; i++) {
+      zwlr_screencopy_frame_v1_send_damage (frame->resource,
+                                            rects[i].x1, rects[i].y1,
+                                            rects[i].x2 - rects[i].x1,
+                                            rects[i].y2 - rects[i].y1);
+    }
+  }
+
+  send_ready (frame);
+}
+
+/*
+ * Fill the frame's buffer from the cached thumbnail and only render
+ * what got damaged since. If the renderer supports it the read back
+ * happens asynchronously.
+ *
+ * Returns: %TRUE if the frame waits for the read back to finish,
+ *   %FALSE if the frame's events got sent already.
+ */
+static gboolean
+thumbnail_render_frame (PhocThumbnail *thumbnail, PhocPhoshPrivateScreencopyFrame *frame)
+{
+  PhocRenderer *renderer = phoc_server_get_renderer (phoc_server_get_default ());
+  gboolean pending = FALSE;
+  pixman_region32_t damage;
+
+  pixman_region32_init (&damage);
+
+  if (thumbnail->pixels) {
+    pixman_region32_copy (&damage, &thumbnail->damage);
+  } else {
+    /* Nothing usable cached yet, render everything */
+    pixman_region32_union_rect (&damage, &damage, 0, 0, thumbnail->width, thumbnail->height);
+  }
+
+  if (pixman_region32_not_empty (&damage)) {
+    frame->readback = phoc_renderer_start_view_readback (renderer, thumbnail->view,
+                                                         thumbnail->width, thumbnail->height);
+    if (frame->readback) {
+      /* Damage from now on goes into the next thumbnail */
+      pixman_region32_copy (&frame->damage, &damage);
+      pixman_region32_clear (&thumbnail->damage);
+      pending = TRUE;
+      goto out;
+    }
+  }
+
+  if (thumbnail->pixels && !thumbnail_copy_pixels (thumbnail, frame->buffer, TRUE)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    goto out;
+  }
+
+  if (pixman_region32_not_empty (&damage)) {
+    if (!phoc_renderer_render_view_to_buffer (renderer, thumbnail->view, frame->buffer,
+                                              thumbnail->pixels ? &damage : NULL) ||
+        !thumbnail_copy_pixels (thumbnail, frame->buffer, FALSE)) {
+      zwlr_screencopy_frame_v1_send_failed (frame->resource);
+      thumbnail_reset (thumbnail);
+      goto out;
+    }
+    pixman_region32_clear (&thumbnail->damage);
+  }
+
+  send_frame (frame, &damage);
+
+ out:
+  pixman_region32_fini (&damage);
+  return pending;
+}
+
+/*
+ * The GPU finished reading back the frame's pixels. Fill the frame's
+ * buffer and send its events.
+ */
+static void
+thumbnail_finish_frame (PhocThumbnail *thumbnail, PhocPhoshPrivateScreencopyFrame *frame)
+{
+  gboolean cached = !!thumbnail->pixels;
+
+  /* The thumbnail got resized in the meantime */
+  if (thumbnail->width != frame->width || thumbnail->height != frame->height ||
+      thumbnail->stride != frame->stride) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    return;
+  }
+
+  /* The read back holds the whole view so only use the cache if there's one */
+  if ((cached && !thumbnail_copy_pixels (thumbnail, frame->buffer, TRUE)) ||
+      !phoc_render_readback_finish (frame->readback, frame->buffer,
+                                    cached ? &frame->damage : NULL) ||
+      !thumbnail_copy_pixels (thumbnail, frame->buffer, FALSE)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    thumbnail_reset (thumbnail);
+    return;
+  }
+
+  send_frame (frame, &frame->damage);
+}
+
+
+static void
+record_stall (PhocPhoshPrivate *self, gint64 stall)
+{
+  self->stats.n_frames++;
+  self->stats.total_stall_us += stall;
+  self->stats.max_stall_us = MAX (self->stats.max_stall_us, stall);
+}
+
+/*
+ * Check whether the GPU finished the read backs. They finish in
+ * order so stop at the first one that's still busy.
+ */
+static gboolean
+on_readback_poll (gpointer data)
+{
+  PhocPhoshPrivate *self = PHOC_PHOSH_PRIVATE (data);
   PhocPhoshPrivateScreencopyFrame *frame;
+
+  while ((frame = g_queue_peek_head (self->readback_queue))) {
+    PhocThumbnail *thumbnail;
+    gint64 start;
+
+    if (!phoc_render_readback_is_done (frame->readback))
+      return G_SOURCE_CONTINUE;
+
+    g_queue_pop_head (self->readback_queue);
+    thumbnail = g_steal_pointer (&frame->thumbnail);
+
+    start = g_get_monotonic_time ();
+    thumbnail_finish_frame (thumbnail, frame);
+    record_stall (self, frame->stall_us + g_get_monotonic_time () - start);
+
+    g_clear_pointer (&frame->readback, phoc_render_readback_free);
+    wlr_buffer_unlock (frame->buffer);
+  }
+
+  self->readback_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Render one queued thumbnail per main loop iteration and only when
+ * there's nothing else to do so output frames aren't delayed by
+ * a burst of thumbnail requests.
+ */
+static gboolean
+on_render_queue_idle (gpointer data)
+{
+  PhocPhoshPrivate *self = PHOC_PHOSH_PRIVATE (data);
+  PhocPhoshPrivateScreencopyFrame *frame;
+  gboolean pending;
+  gint64 start, stall;
+
+  frame = g_queue_pop_head (self->render_queue);
+  if (frame == NULL) {
+    self->render_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  start = g_get_monotonic_time ();
+  pending = thumbnail_render_frame (frame->thumbnail, frame);
+  stall = g_get_monotonic_time () - start;
+
+  if (pending) {
+    frame->stall_us = stall;
+    g_queue_push_tail (self->readback_queue, frame);
+    if (self->readback_id == 0) {
+      self->readback_id = g_timeout_add (get_readback_poll_ms (frame->thumbnail->view),
+                                         on_readback_poll, self);
+      g_source_set_name_by_id (self->readback_id, "[phoc] thumbnail read back");
+    }
+    return G_SOURCE_CONTINUE;
+  }
+
+  frame->thumbnail = NULL;
+  record_stall (self, stall);
+  wlr_buffer_unlock (frame->buffer);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/* Check once per frame of the view's output */
+static guint
+get_readback_poll_ms (PhocView *view)
+{
+  PhocOutput *output = phoc_view_get_output (view);
+
+  if (output == NULL || output->wlr_output->refresh <= 0)
+    return PHOC_PHOSH_PRIVATE_READBACK_POLL_MS;
+
+  return (1000 * 1000 + output->wlr_output->refresh - 1) / output->wlr_output->refresh;
+}
+
+
+static void
+queue_render (PhocPhoshPrivate *self, PhocThumbnail *thumbnail, PhocPhoshPrivateScreencopyFrame *frame)
+{
+  frame->thumbnail = thumbnail;
+  g_queue_push_tail (self->render_queue, frame);
+
+  if (self->render_id)
+    return;
+
+  self->render_id = g_idle_add (on_render_queue_idle, self);
+  g_source_set_name_by_id (self->render_id, "[phoc] thumbnail render");
+}
+
+
+static void
+on_thumbnail_content_damaged (PhocView *view, pixman_region32_t *view_damage, PhocThumbnail *thumbnail)
+{
+  struct wlr_box geo;
+  pixman_region32_t damage;
+  float scale;
+
+  /* Track damage even before anything got cached: A read back might be
+   * in flight and what it captured is outdated by this damage. */
+  phoc_view_get_geometry (view, &geo);
+  if (wlr_box_empty (&geo))
+    return;
+
+  /* Same scaling as phoc_renderer_render_view_to_buffer () */
+  scale = fmin (thumbnail->width / (float)geo.width, thumbnail->height / (float)geo.height);
+
+  pixman_region32_init (&damage);
+  pixman_region32_copy (&damage, view_damage);
+  pixman_region32_translate (&damage, -geo.x, -geo.y);
+  wlr_region_scale (&damage, &damage, scale);
+  /* Account for filtering when scaling down */
+  wlr_region_expand (&damage, &damage, 1);
+  pixman_region32_intersect_rect (&damage, &damage, 0, 0, thumbnail->width, thumbnail->height);
+  pixman_region32_union (&thumbnail->damage, &thumbnail->damage, &damage);
+  pixman_region32_fini (&damage);
+
+  if (!pixman_region32_not_empty (&thumbnail->damage))
+    return;
+
+  for (GSList *l = thumbnail->pending; l; l = l->next)
+    queue_render (thumbnail->phosh, thumbnail, l->data);
+  g_clear_pointer (&thumbnail->pending, g_slist_free);
+}
+
+
+static void
+on_thumbnail_surface_destroy (PhocView *view, PhocThumbnail *thumbnail)
+{
+  g_hash_table_remove (thumbnail->phosh->thumbnails, view);
+}
+
+
+static void
+thumbnail_steal_queued (PhocThumbnail *thumbnail, GQueue *queue)
+{
+  for (GList *l = queue->head; l;) {
+    PhocPhoshPrivateScreencopyFrame *frame = l->data;
+    GList *next = l->next;
+
+    if (frame->thumbnail == thumbnail) {
+      g_queue_delete_link (queue, l);
+      g_clear_pointer (&frame->readback, phoc_render_readback_free);
+      thumbnail->pending = g_slist_prepend (thumbnail->pending, frame);
+    }
+    l = next;
+  }
+}
+
+
+static void
+thumbnail_free (PhocThumbnail *thumbnail)
+{
+  g_signal_handlers_disconnect_by_data (thumbnail->view, thumbnail);
+
+  thumbnail_steal_queued (thumbnail, thumbnail->phosh->render_queue);
+  thumbnail_steal_queued (thumbnail, thumbnail->phosh->readback_queue);
+
+  for (GSList *l = thumbnail->pending; l; l = l->next) {
+    PhocPhoshPrivateScreencopyFrame *frame = l->data;
+
+    frame->thumbnail = NULL;
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    wlr_buffer_unlock (frame->buffer);
+  }
+  g_slist_free (thumbnail->pending);
+
+  g_free (thumbnail->pixels);
+  pixman_region32_fini (&thumbnail->damage);
+  g_free (thumbnail);
+}
+
+
+static PhocThumbnail *
+thumbnail_get (PhocPhoshPrivate *phosh, PhocView *view, PhocPhoshPrivateScreencopyFrame *frame)
+{
+  PhocThumbnail *thumbnail = g_hash_table_lookup (phosh->thumbnails, view);
+
+  if (thumbnail == NULL) {
+    thumbnail = g_new0 (PhocThumbnail, 1);
+    thumbnail->phosh = phosh;
+    thumbnail->view = view;
+    pixman_region32_init (&thumbnail->damage);
+
+    g_signal_connect (view, "content-damaged", G_CALLBACK (on_thumbnail_content_damaged), thumbnail);
+    g_signal_connect (view, "surface-destroy", G_CALLBACK (on_thumbnail_surface_destroy), thumbnail);
+    g_hash_table_insert (phosh->thumbnails, view, thumbnail);
+  }
+
+  /* The overview asked for a different size, start over */
+  if (thumbnail->width != frame->width || thumbnail->height != frame->height ||
+      thumbnail->stride != frame->stride) {
+    thumbnail_reset (thumbnail);
+    thumbnail->width = frame->width;
+    thumbnail->height = frame->height;
+    thumbnail->stride = frame->stride;
+  }
+
+  return thumbnail;
+}
+
+
+static void
+thumbnail_frame_copy (struct wl_resource *frame_resource,
+                      struct wl_resource *buffer_resource,
+                      gboolean            with_damage)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocPhoshPrivate *phosh = phoc_desktop_get_phosh_private (desktop);
+  PhocPhoshPrivateScreencopyFrame *frame;
+  PhocThumbnail *thumbnail;
   struct wlr_shm_attributes attribs;
 
   frame = phoc_phosh_private_screencopy_frame_from_resource (frame_resource);
@@ -455,33 +879,41 @@ thumbnail_frame_handle_copy (struct wl_client   *wl_client,
   PhocView *view = frame->view;
   g_signal_handlers_disconnect_by_data (frame->view, frame);
   frame->view = NULL;
+  frame->with_damage = with_damage;
 
-  if (!phoc_renderer_render_view_to_buffer (self, view, frame->buffer)) {
-    zwlr_screencopy_frame_v1_send_failed (frame->resource);
-    goto unlock_buffer;
-  }
+  thumbnail = thumbnail_get (phosh, view, frame);
 
-  zwlr_screencopy_frame_v1_send_flags (frame->resource, 0);
+  /* Wait until the view's content changes */
+  if (with_damage && thumbnail->pixels && !pixman_region32_not_empty (&thumbnail->damage)) {
+    frame->thumbnail = thumbnail;
+    thumbnail->pending = g_slist_append (thumbnail->pending, frame);
+    return;
+  }
 
-  struct timespec now;
-  clock_gettime (CLOCK_MONOTONIC, &now);
-  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
-  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
-  zwlr_screencopy_frame_v1_send_ready (frame->resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+  /* Don't render and read back while dispatching client requests */
+  queue_render (phosh, thumbnail, frame);
+  return;
 
 unlock_buffer:
   wlr_buffer_unlock (frame->buffer);
 }
 
+
+static void
+thumbnail_frame_handle_copy (struct wl_client   *wl_client,
+                             struct wl_resource *frame_resource,
+                             struct wl_resource *buffer_resource)
+{
+  thumbnail_frame_copy (frame_resource, buffer_resource, FALSE);
+}
+
+
 static void
 thumbnail_frame_handle_copy_with_damage (struct wl_client   *wl_client,
                                          struct wl_resource *frame_resource,
                                          struct wl_resource *buffer_resource)
 {
-  // XXX: unimplemented
-  (void)wl_client;
-  (void)buffer_resource;
-  zwlr_screencopy_frame_v1_send_failed (frame_resource);
+  thumbnail_frame_copy (frame_resource, buffer_resource, TRUE);
 }
 
 static void
@@ -534,6 +966,8 @@ handle_get_thumbnail (struct wl_client *client,
     return;
   }
 
+  pixman_region32_init (&frame->damage);
+
   g_debug ("new phosh_private_screencopy_frame %p (res %p)", frame, frame->resource);
   wl_resource_set_implementation (frame->resource,
                                   &phoc_phosh_private_screencopy_frame_impl,
@@ -782,6 +1216,11 @@ phoc_phosh_private_finalize (GObject *object)
 {
   PhocPhoshPrivate *self = PHOC_PHOSH_PRIVATE (object);
 
+  g_clear_handle_id (&self->render_id, g_source_remove);
+  g_clear_handle_id (&self->readback_id, g_source_remove);
+  g_clear_pointer (&self->thumbnails, g_hash_table_destroy);
+  g_clear_pointer (&self->render_queue, g_queue_free);
+  g_clear_pointer (&self->readback_queue, g_queue_free);
   wl_global_destroy (self->global);
 
   G_OBJECT_CLASS (phoc_phosh_private_parent_class)->finalize (object);
@@ -818,6 +1257,10 @@ static void
 phoc_phosh_private_init (PhocPhoshPrivate *self)
 {
   self->last_action_id = 1;
+  self->thumbnails = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                            NULL, (GDestroyNotify)thumbnail_free);
+  self->render_queue = g_queue_new ();
+  self->readback_queue = g_queue_new ();
 }
 
 
@@ -833,36 +1276,29 @@ phoc_phosh_private_forward_keysym (PhocKeyCombo *combo,
                                    uint32_t      timestamp,
                                    bool          pressed)
 {
-  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
-  PhocPhoshPrivate *phosh = phoc_desktop_get_phosh_private (desktop);
-  GList *l;
-  bool forwarded = false;
-
-  for (l = phosh->keyboard_events; l != NULL; l = l->next) {
-    PhocPhoshPrivateKeyboardEventData *kbevent = l->data;
-    uint32_t version = wl_resource_get_version (kbevent->resource);
-
-    g_debug("addr of kbevent and res kbev %p res %p", kbevent, kbevent->resource);
-    /*  forward the keysym if it is has been subscribed to */
-    if (phoc_phosh_private_keyboard_event_accelerator_is_registered (combo, kbevent)) {
-      gint64 key = ((gint64)combo->modifiers << 32) | combo->keysym;
-      guint action_id = GPOINTER_TO_UINT (g_hash_table_lookup (kbevent->subscribed_accelerators, &key));
-
-      if (pressed) {
-        phosh_private_keyboard_event_send_accelerator_activated_event (kbevent->resource,
-                                                                       action_id,
-                                                                       timestamp);
-        forwarded = true;
-      } else if (version >= PHOSH_PRIVATE_KEYBOARD_EVENT_ACCELERATOR_RELEASED_EVENT_SINCE_VERSION) {
-        phosh_private_keyboard_event_send_accelerator_released_event (kbevent->resource,
-                                                                      action_id,
-                                                                      timestamp);
-        forwarded = true;
-      }
-    }
+  PhocPhoshPrivateKeyboardEventData *kbevent;
+  guint action_id;
+  uint32_t version;
+
+  /*  forward the keysym if it is has been subscribed to */
+  kbevent = phoc_keybindings_lookup_grab (get_keybindings (), combo, &action_id);
+  if (kbevent == NULL)
+    return false;
+
+  version = wl_resource_get_version (kbevent->resource);
+  if (pressed) {
+    phosh_private_keyboard_event_send_accelerator_activated_event (kbevent->resource,
+                                                                   action_id,
+                                                                   timestamp);
+    return true;
+  } else if (version >= PHOSH_PRIVATE_KEYBOARD_EVENT_ACCELERATOR_RELEASED_EVENT_SINCE_VERSION) {
+    phosh_private_keyboard_event_send_accelerator_released_event (kbevent->resource,
+                                                                  action_id,
+                                                                  timestamp);
+    return true;
   }
 
-  return forwarded;
+  return false;
 }
 
 void
@@ -924,3 +1360,21 @@ phoc_phosh_private_get_global (PhocPhoshPrivate *self)
 
   return self->global;
 }
+
+
+/**
+ * phoc_phosh_private_get_thumbnail_stats:
+ * @self: The phosh private protocol
+ * @stats: (out): The thumbnail statistics
+ *
+ * Get statistics on how long rendering thumbnails blocked the main loop.
+ */
+void
+phoc_phosh_private_get_thumbnail_stats (PhocPhoshPrivate               *self,
+                                        PhocPhoshPrivateThumbnailStats *stats)
+{
+  g_assert (PHOC_IS_PHOSH_PRIVATE (self));
+  g_assert (stats);
+
+  *stats = self->stats;
+}
@@ -23,6 +23,20 @@ typedef enum {
   PHOC_PHOSH_PRIVATE_SHELL_STATE_UP      = 1,
 } PhocPhoshPrivateShellState;
 
+/**
+ * PhocPhoshPrivateThumbnailStats:
+ * @n_frames: The number of thumbnails rendered
+ * @total_stall_us: Time spent rendering and reading back thumbnails
+ * @max_stall_us: The longest time a single thumbnail blocked the main loop
+ *
+ * Statistics on thumbnail rendering.
+ */
+typedef struct {
+  guint  n_frames;
+  gint64 total_stall_us;
+  gint64 max_stall_us;
+} PhocPhoshPrivateThumbnailStats;
+
 PhocPhoshPrivate *phoc_phosh_private_new (void);
 bool              phoc_phosh_private_forward_keysym (PhocKeyCombo *combo, uint32_t timestamp, bool pressed);
 void              phoc_phosh_private_notify_startup_id (PhocPhoshPrivate                           *self,
@@ -33,5 +47,7 @@ void              phoc_phosh_private_notify_launch (PhocPhoshPrivate
                                                     enum phosh_private_startup_tracker_protocol proto);
 PhocPhoshPrivateShellState phoc_phosh_private_get_shell_state (PhocPhoshPrivate *self);
 struct wl_global *phoc_phosh_private_get_global     (PhocPhoshPrivate *self);
+void              phoc_phosh_private_get_thumbnail_stats (PhocPhoshPrivate               *self,
+                                                          PhocPhoshPrivateThumbnailStats *stats);
 
 G_END_DECLS
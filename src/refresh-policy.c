@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-refresh-policy"
+
+#include "phoc-config.h"
+
+#include "refresh-policy.h"
+
+/* How long committed frames get counted before the rate is evaluated */
+#define PHOC_REFRESH_POLICY_INTERVAL_US G_USEC_PER_SEC
+/* Allowed jitter when comparing the content's rate with the low rate */
+#define PHOC_REFRESH_POLICY_JITTER_MHZ 1000
+/* Consecutive intervals content must outpace the low rate to leave it */
+#define PHOC_REFRESH_POLICY_OUTPACED_CHECKS 3
+
+/**
+ * PhocRefreshPolicy:
+ *
+ * Decides whether an output should run at its regular or at a reduced
+ * refresh rate based on the rate at which frames get committed.
+ *
+ * Static content or content updating no faster than the low rate
+ * switches to the low rate. Input, animations and pending frame
+ * callbacks mark the output busy which switches back to the high rate.
+ *
+ * Content at or below the low rate keeps the output at the low
+ * rate. At the low rate the committed frames can't tell whether
+ * content wants more so the policy looks at the content updates
+ * instead: Only if clients update their content faster than the low
+ * rate for several intervals in a row it switches back to the high
+ * rate.
+ */
+struct _PhocRefreshPolicy {
+  int      low_mhz;
+
+  guint    n_frames;
+  guint    n_updates;
+  gboolean busy;
+  gint64   check_us;
+  guint    n_outpaced;
+};
+
+/**
+ * phoc_refresh_policy_new:
+ * @low_mhz: The low refresh rate in mHz
+ * @now_us: The current monotonic time
+ *
+ * Returns: (transfer full): A new refresh policy
+ */
+PhocRefreshPolicy *
+phoc_refresh_policy_new (int low_mhz, gint64 now_us)
+{
+  PhocRefreshPolicy *self = g_new0 (PhocRefreshPolicy, 1);
+
+  self->low_mhz = low_mhz;
+  self->check_us = now_us;
+
+  return self;
+}
+
+
+void
+phoc_refresh_policy_free (PhocRefreshPolicy *self)
+{
+  g_free (self);
+}
+
+
+static void
+start_interval (PhocRefreshPolicy *self, gint64 now_us)
+{
+  self->n_frames = 0;
+  self->n_updates = 0;
+  self->busy = FALSE;
+  self->check_us = now_us;
+}
+
+/**
+ * phoc_refresh_policy_reset:
+ * @self: The refresh policy
+ * @now_us: The current monotonic time
+ *
+ * Start over. Invoke this when the refresh rate changed so frames
+ * committed at the previous rate don't count.
+ */
+void
+phoc_refresh_policy_reset (PhocRefreshPolicy *self, gint64 now_us)
+{
+  start_interval (self, now_us);
+  self->n_outpaced = 0;
+}
+
+/**
+ * phoc_refresh_policy_frame_done:
+ * @self: The refresh policy
+ *
+ * Account for a committed frame.
+ */
+void
+phoc_refresh_policy_frame_done (PhocRefreshPolicy *self)
+{
+  self->n_frames++;
+}
+
+/**
+ * phoc_refresh_policy_content_update:
+ * @self: The refresh policy
+ *
+ * Account for a client updating content shown on the output.
+ */
+void
+phoc_refresh_policy_content_update (PhocRefreshPolicy *self)
+{
+  self->n_updates++;
+}
+
+/**
+ * phoc_refresh_policy_mark_busy:
+ * @self: The refresh policy
+ *
+ * Mark the current interval as busy, e.g. due to input or animations.
+ */
+void
+phoc_refresh_policy_mark_busy (PhocRefreshPolicy *self)
+{
+  self->busy = TRUE;
+}
+
+/**
+ * phoc_refresh_policy_is_due:
+ * @self: The refresh policy
+ * @now_us: The current monotonic time
+ *
+ * Returns: %TRUE if the current interval is long enough to be evaluated
+ */
+gboolean
+phoc_refresh_policy_is_due (PhocRefreshPolicy *self, gint64 now_us)
+{
+  return now_us - self->check_us >= PHOC_REFRESH_POLICY_INTERVAL_US;
+}
+
+
+static gint64
+get_rate_mhz (guint n, gint64 interval_us)
+{
+  return (n * G_USEC_PER_SEC * (gint64)1000) / MAX (interval_us, 1);
+}
+
+/**
+ * phoc_refresh_policy_evaluate:
+ * @self: The refresh policy
+ * @current: The refresh rate the output currently runs at
+ * @busy: Whether the output is busy for reasons not tracked by the policy
+ * @now_us: The current monotonic time
+ *
+ * Evaluate the frames committed since the last evaluation and start
+ * a new interval.
+ *
+ * Returns: The refresh rate the output should run at
+ */
+PhocRefreshRate
+phoc_refresh_policy_evaluate (PhocRefreshPolicy *self,
+                              PhocRefreshRate    current,
+                              gboolean           busy,
+                              gint64             now_us)
+{
+  gint64 content_mhz, updates_mhz;
+
+  content_mhz = get_rate_mhz (self->n_frames, now_us - self->check_us);
+  updates_mhz = get_rate_mhz (self->n_updates, now_us - self->check_us);
+  busy = busy || self->busy;
+  start_interval (self, now_us);
+
+  if (busy) {
+    self->n_outpaced = 0;
+    return PHOC_REFRESH_RATE_HIGH;
+  }
+
+  if (current == PHOC_REFRESH_RATE_LOW) {
+    if (updates_mhz <= self->low_mhz + PHOC_REFRESH_POLICY_JITTER_MHZ) {
+      self->n_outpaced = 0;
+      return PHOC_REFRESH_RATE_LOW;
+    }
+
+    self->n_outpaced++;
+    if (self->n_outpaced < PHOC_REFRESH_POLICY_OUTPACED_CHECKS)
+      return PHOC_REFRESH_RATE_LOW;
+
+    g_debug ("Content updating at %" G_GINT64_FORMAT "mHz outpaces %dmHz",
+             updates_mhz, self->low_mhz);
+    self->n_outpaced = 0;
+    return PHOC_REFRESH_RATE_HIGH;
+  }
+
+  /* Static content or content updating no faster than the low rate */
+  if (content_mhz <= self->low_mhz + PHOC_REFRESH_POLICY_JITTER_MHZ) {
+    g_debug ("Content at %" G_GINT64_FORMAT "mHz, switching to %dmHz", content_mhz, self->low_mhz);
+    return PHOC_REFRESH_RATE_LOW;
+  }
+
+  return PHOC_REFRESH_RATE_HIGH;
+}
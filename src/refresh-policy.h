@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocRefreshRate:
+ * @PHOC_REFRESH_RATE_HIGH: The output's regular refresh rate
+ * @PHOC_REFRESH_RATE_LOW: The reduced refresh rate used for slowly updating content
+ *
+ * The refresh rates a [struct@RefreshPolicy] switches between.
+ */
+typedef enum _PhocRefreshRate {
+  PHOC_REFRESH_RATE_HIGH,
+  PHOC_REFRESH_RATE_LOW,
+} PhocRefreshRate;
+
+typedef struct _PhocRefreshPolicy PhocRefreshPolicy;
+
+PhocRefreshPolicy *phoc_refresh_policy_new            (int                low_mhz,
+                                                       gint64             now_us);
+void               phoc_refresh_policy_free           (PhocRefreshPolicy *self);
+void               phoc_refresh_policy_reset          (PhocRefreshPolicy *self,
+                                                       gint64             now_us);
+void               phoc_refresh_policy_frame_done     (PhocRefreshPolicy *self);
+void               phoc_refresh_policy_content_update (PhocRefreshPolicy *self);
+void               phoc_refresh_policy_mark_busy      (PhocRefreshPolicy *self);
+gboolean           phoc_refresh_policy_is_due         (PhocRefreshPolicy *self,
+                                                       gint64             now_us);
+PhocRefreshRate    phoc_refresh_policy_evaluate       (PhocRefreshPolicy *self,
+                                                       PhocRefreshRate    current,
+                                                       gboolean           busy,
+                                                       gint64             now_us);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocRefreshPolicy, phoc_refresh_policy_free)
+
+G_END_DECLS
@@ -5,13 +5,30 @@
  */
 #pragma once
 
+#include "output.h"
 #include "render.h"
 
 #include <wlr/types/wlr_output.h>
 
 G_BEGIN_DECLS
 
+#define PHOC_RENDERER_MAX_OFFLOADED 3
+
 struct wlr_renderer  *phoc_renderer_get_wlr_renderer  (PhocRenderer *self);
 struct wlr_allocator *phoc_renderer_get_wlr_allocator (PhocRenderer *self);
+struct wlr_surface   *phoc_renderer_find_scanout_surface (PhocRenderer      *self,
+                                                          PhocOutput        *output,
+                                                          PhocOutputScanout *status);
+guint                 phoc_renderer_get_layer_candidates (PhocRenderer        *self,
+                                                          PhocOutput          *output,
+                                                          struct wlr_surface **surfaces,
+                                                          struct wlr_box      *boxes,
+                                                          guint                max);
+void                  phoc_renderer_set_offloaded_surfaces (PhocRenderer        *self,
+                                                            struct wlr_surface **surfaces,
+                                                            guint                n_surfaces);
+void                  phoc_renderer_get_target_pool_stats (PhocRenderer *self,
+                                                           guint        *hits,
+                                                           guint        *misses);
 
 G_END_DECLS
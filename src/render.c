@@ -27,6 +27,7 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/backend.h>
 #include <wlr/config.h>
@@ -39,14 +40,19 @@
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/util/box.h>
 #include <wlr/util/region.h>
 #include <wlr/render/allocator.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
 
 #define TOUCH_POINT_SIZE 20
 #define TOUCH_POINT_BORDER 0.1
 
+#define PHOC_RENDERER_TARGET_POOL_SIZE          8
+#define PHOC_RENDERER_TARGET_POOL_IDLE_TIMEOUT  5 /* seconds */
+
 #define COLOR_BLACK                ((struct wlr_render_color){0.0f, 0.0f, 0.0f, 1.0f})
 #define COLOR_TRANSPARENT          {0.0f, 0.0f, 0.0f, 0.0f}
 #define COLOR_TRANSPARENT_WHITE    ((struct wlr_render_color){0.5f, 0.5f, 0.5f, 0.5f})
@@ -79,6 +85,39 @@ struct _PhocRenderer {
   struct wlr_backend   *wlr_backend;
   struct wlr_renderer  *wlr_renderer;
   struct wlr_allocator *wlr_allocator;
+
+  /* Occlusion culling */
+  GArray               *scene;          /* PhocSceneSurface, back to front */
+  GHashTable           *surface_damage; /* wlr_surface → PhocSceneSurface */
+
+  /* Surfaces put on output layers by the output currently drawn */
+  struct wlr_surface   *offloaded[PHOC_RENDERER_MAX_OFFLOADED];
+  guint                 n_offloaded;
+
+  /* Render targets for thumbnails */
+  GPtrArray            *target_pool;    /* idle wlr_buffer, least recently used first */
+  guint                 target_pool_trim_id;
+  guint                 target_pool_hits;
+  guint                 target_pool_misses;
+
+  /* Whether pixels can be read back via PBOs, -1 if not checked yet */
+  int                   pbo_readback;
+};
+
+/**
+ * PhocRenderReadback:
+ *
+ * A read back of a rendered view into a pixel buffer object. The GPU
+ * copies the pixels in the background, the fence signals once it's
+ * done.
+ */
+struct _PhocRenderReadback {
+  struct wlr_egl *egl;
+  GLuint          pbo;
+  GLsync          fence;
+  int             width;
+  int             height;
+  size_t          stride;
 };
 
 static void phoc_renderer_initable_iface_init (GInitableIface *iface);
@@ -99,6 +138,37 @@ struct touch_point_data {
   double y;
 };
 
+/*
+ * A surface in the output's scene together with the part of the
+ * damage that is not occluded by opaque surfaces in front of it
+ */
+typedef struct {
+  struct wlr_surface *surface;
+  struct wlr_box      box;
+  float               scale;
+  float               alpha;
+  gboolean            offloadable;
+  pixman_region32_t   damage;
+} PhocSceneSurface;
+
+struct scene_collect_data {
+  PhocRenderer *self;
+  float         alpha;
+  gboolean      offloadable;
+};
+
+
+static gboolean
+is_offloaded (PhocRenderer *self, struct wlr_surface *surface)
+{
+  for (guint i = 0; i < self->n_offloaded; i++) {
+    if (self->offloaded[i] == surface)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 
 static void
 wlr_box_from_pixman_box32 (struct wlr_box *dest, const pixman_box32_t box)
@@ -158,6 +228,7 @@ render_texture (PhocOutput               *output,
                 const struct wlr_box     *clip_box,
                 enum wl_output_transform  surface_transform,
                 float                     alpha,
+                const pixman_region32_t  *output_damage,
                 PhocRenderContext        *ctx)
 {
   pixman_region32_t damage;
@@ -165,7 +236,7 @@ render_texture (PhocOutput               *output,
   struct wlr_fbox src_box = {0};
   enum wl_output_transform transform;
 
-  if (!phoc_utils_is_damaged (&proj_box, ctx->damage, clip_box, &damage))
+  if (!phoc_utils_is_damaged (&proj_box, output_damage, clip_box, &damage))
     goto buffer_damage_finish;
 
   if (_src_box)
@@ -175,6 +246,7 @@ render_texture (PhocOutput               *output,
   phoc_output_transform_damage (output, &damage);
   transform = wlr_output_transform_compose (surface_transform, output->wlr_output->transform);
 
+  ctx->n_draws++;
   wlr_render_pass_add_texture (ctx->render_pass, &(struct wlr_render_texture_options) {
       .texture = texture,
       .src_box = src_box,
@@ -227,13 +299,25 @@ render_surface_iterator (PhocOutput         *output,
                          void               *data)
 {
   PhocRenderContext *ctx = data;
+  PhocRenderer *self = phoc_server_get_renderer (phoc_server_get_default ());
   struct wlr_output *wlr_output = output->wlr_output;
   float alpha = ctx->alpha;
+  const pixman_region32_t *damage = ctx->damage;
+  PhocSceneSurface *scene_surface;
 
   struct wlr_texture *texture = wlr_surface_get_texture (surface);
   if (!texture)
     return;
 
+  /* The output shows these on a layer of their own */
+  if (is_offloaded (self, surface))
+    return;
+
+  /* Only paint what isn't covered by opaque surfaces in front of us */
+  scene_surface = g_hash_table_lookup (self->surface_damage, surface);
+  if (scene_surface)
+    damage = &scene_surface->damage;
+
   struct wlr_fbox src_box;
   wlr_surface_get_buffer_source_box (surface, &src_box);
 
@@ -245,7 +329,8 @@ render_surface_iterator (PhocOutput         *output,
   phoc_utils_scale_box (&clip_box, scale);
   phoc_utils_scale_box (&clip_box, wlr_output->scale);
 
-  render_texture (output, texture, &src_box, &dst_box, &clip_box, surface->current.transform, alpha, ctx);
+  render_texture (output, texture, &src_box, &dst_box, &clip_box, surface->current.transform, alpha,
+                  damage, ctx);
 
   wlr_presentation_surface_scanned_out_on_output (output->desktop->presentation,
                                                   surface,
@@ -474,6 +559,75 @@ view_render_to_buffer_iterator (struct wlr_surface *surface, int sx, int sy, voi
 }
 
 
+static gboolean
+on_render_target_pool_idle (gpointer data)
+{
+  PhocRenderer *self = PHOC_RENDERER (data);
+
+  g_debug ("Trimming %u idle render targets, %u hits, %u misses",
+           self->target_pool->len, self->target_pool_hits, self->target_pool_misses);
+  g_ptr_array_set_size (self->target_pool, 0);
+
+  self->target_pool_trim_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Get a render target from the pool or allocate a new one. Targets are
+ * bucketed by their exact size as thumbnails are read back from the
+ * buffer's origin.
+ */
+static struct wlr_buffer *
+acquire_render_target (PhocRenderer *self, int width, int height)
+{
+  struct wlr_drm_format_set fmt_set = {};
+  const struct wlr_drm_format *fmt;
+  struct wlr_buffer *buffer;
+
+  /* Most recently used targets come last */
+  for (int i = (int)self->target_pool->len - 1; i >= 0; i--) {
+    buffer = g_ptr_array_index (self->target_pool, i);
+
+    if (buffer->width == width && buffer->height == height) {
+      self->target_pool_hits++;
+      return g_ptr_array_steal_index (self->target_pool, i);
+    }
+  }
+
+  self->target_pool_misses++;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+
+  return buffer;
+}
+
+/*
+ * Put a render target back into the pool. The least recently used
+ * target is dropped when the pool is full and the whole pool once
+ * there were no thumbnail requests for a while.
+ */
+static void
+release_render_target (PhocRenderer *self, struct wlr_buffer *buffer)
+{
+  guint id;
+
+  if (self->target_pool->len == PHOC_RENDERER_TARGET_POOL_SIZE)
+    g_ptr_array_remove_index (self->target_pool, 0);
+
+  g_ptr_array_add (self->target_pool, buffer);
+
+  g_clear_handle_id (&self->target_pool_trim_id, g_source_remove);
+  id = g_timeout_add_seconds (PHOC_RENDERER_TARGET_POOL_IDLE_TIMEOUT,
+                              on_render_target_pool_idle,
+                              self);
+  g_source_set_name_by_id (id, "[phoc] render target pool trim");
+  self->target_pool_trim_id = id;
+}
+
+
 /* FIXME: Rework when switching to wlroots 0.18.x git again */
 static gboolean
 phoc_renderer_render_view_to_buffer_android (PhocRenderer      *self,
@@ -556,10 +710,225 @@ phoc_renderer_render_view_to_buffer_android (PhocRenderer      *self,
   return true;
 }
 
+static gboolean
+check_pbo_readback (PhocRenderer *self)
+{
+  const char *version, *exts;
+
+  if (self->pbo_readback != -1)
+    return self->pbo_readback;
+
+  self->pbo_readback = FALSE;
+  if (!wlr_renderer_is_gles2 (self->wlr_renderer) || self->wlr_allocator == NULL)
+    return FALSE;
+
+  if (!wlr_egl_make_current (wlr_gles2_renderer_get_egl (self->wlr_renderer)))
+    return FALSE;
+
+  /* PBOs and fences need GLES3, reading ARGB8888 needs BGRA */
+  version = (const char *)glGetString (GL_VERSION);
+  exts = (const char *)glGetString (GL_EXTENSIONS);
+  self->pbo_readback = (version && g_str_has_prefix (version, "OpenGL ES 3") &&
+                        exts && strstr (exts, "GL_EXT_read_format_bgra"));
+  wlr_egl_unset_current (wlr_gles2_renderer_get_egl (self->wlr_renderer));
+
+  g_debug ("Asynchronous read back %ssupported", self->pbo_readback ? "" : "not ");
+  return self->pbo_readback;
+}
+
+/**
+ * phoc_renderer_start_view_readback:
+ * @self: The renderer
+ * @view: The view to render
+ * @width: The width to render at
+ * @height: The height to render at
+ *
+ * Renders a view's surfaces scaled to the given size like
+ * [method@Renderer.render_view_to_buffer] but doesn't wait for the
+ * GPU. The pixels are copied into a pixel buffer object in the
+ * background. Use [method@RenderReadback.is_done] to check whether
+ * they're available.
+ *
+ * Returns:(transfer full)(nullable): The read back or %NULL if the
+ *   renderer doesn't support asynchronous read backs.
+ */
+PhocRenderReadback *
+phoc_renderer_start_view_readback (PhocRenderer *self, PhocView *view, int width, int height)
+{
+  struct wlr_surface *surface = view->wlr_surface;
+  PhocRenderReadback *readback;
+  struct wlr_buffer *buffer;
+
+  g_return_val_if_fail (surface, NULL);
+
+  if (!check_pbo_readback (self))
+    return NULL;
+
+  buffer = acquire_render_target (self, width, height);
+  if (!buffer)
+    return NULL;
+
+  struct view_render_data render_data = {
+    .view = view,
+    .width = width,
+    .height = height
+  };
+
+  readback = g_new0 (PhocRenderReadback, 1);
+  readback->egl = wlr_gles2_renderer_get_egl (self->wlr_renderer);
+  readback->width = width;
+  readback->height = height;
+  readback->stride = width * 4;
+
+  wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer);
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+  wlr_surface_for_each_surface (surface, view_render_to_buffer_iterator, &render_data);
+
+  /* The buffer's framebuffer is bound, let the GPU copy it into the PBO */
+  glGenBuffers (1, &readback->pbo);
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, readback->pbo);
+  glBufferData (GL_PIXEL_PACK_BUFFER, readback->stride * height, NULL, GL_STREAM_READ);
+  glPixelStorei (GL_PACK_ALIGNMENT, 4);
+  glReadPixels (0, 0, width, height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+  readback->fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  /* Make sure the fence reaches the GPU, polling doesn't flush */
+  glFlush ();
+
+  wlr_renderer_end (self->wlr_renderer);
+
+  /* Commands are serialized so the target can be reused right away */
+  release_render_target (self, buffer);
+
+  return readback;
+}
+
+/**
+ * phoc_render_readback_is_done:
+ * @self: The read back
+ *
+ * Check without blocking whether the GPU finished the read back.
+ *
+ * Returns: %TRUE if the pixels are available
+ */
+gboolean
+phoc_render_readback_is_done (PhocRenderReadback *self)
+{
+  GLenum status;
+
+  if (!wlr_egl_make_current (self->egl))
+    return TRUE;
+
+  status = glClientWaitSync (self->fence, 0, 0);
+  wlr_egl_unset_current (self->egl);
+
+  /* On failure let phoc_render_readback_finish () report the error */
+  return status != GL_TIMEOUT_EXPIRED;
+}
+
+/**
+ * phoc_render_readback_finish:
+ * @self: The read back
+ * @shm_buffer: The buffer to copy the pixels to
+ * @damage: (nullable): The area of @shm_buffer to update
+ *
+ * Copy the read back pixels into @shm_buffer. If @damage is given only
+ * that part of the buffer is updated. Only call this once
+ * [method@RenderReadback.is_done] returned %TRUE as it blocks otherwise.
+ *
+ * Returns: %TRUE on success
+ */
 gboolean
-phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
-                                     PhocView          *view,
-                                     struct wlr_buffer *shm_buffer)
+phoc_render_readback_finish (PhocRenderReadback      *self,
+                             struct wlr_buffer       *shm_buffer,
+                             const pixman_region32_t *damage)
+{
+  gboolean success = FALSE;
+  const guint8 *pixels;
+  void *data;
+  uint32_t format;
+  size_t stride;
+  pixman_region32_t region;
+  pixman_box32_t *rects;
+  int nrects;
+
+  g_return_val_if_fail (shm_buffer->width == self->width, FALSE);
+  g_return_val_if_fail (shm_buffer->height == self->height, FALSE);
+
+  if (!wlr_egl_make_current (self->egl))
+    return FALSE;
+
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, self->pbo);
+  pixels = glMapBufferRange (GL_PIXEL_PACK_BUFFER, 0, self->stride * self->height,
+                             GL_MAP_READ_BIT);
+  if (pixels == NULL)
+    goto out;
+
+  if (!wlr_buffer_begin_data_ptr_access (shm_buffer,
+                                         WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+                                         &data, &format, &stride)) {
+    glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+    goto out;
+  }
+
+  pixman_region32_init_rect (&region, 0, 0, self->width, self->height);
+  if (damage)
+    pixman_region32_intersect (&region, &region, (pixman_region32_t *)damage);
+
+  rects = pixman_region32_rectangles (&region, &nrects);
+  for (int i = 0; i < nrects; i++) {
+    size_t len = (rects[i].x2 - rects[i].x1) * 4;
+
+    for (int y = rects[i].y1; y < rects[i].y2; y++) {
+      memcpy ((guint8 *)data + y * stride + rects[i].x1 * 4,
+              pixels + y * self->stride + rects[i].x1 * 4,
+              len);
+    }
+  }
+  pixman_region32_fini (&region);
+
+  wlr_buffer_end_data_ptr_access (shm_buffer);
+  glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+  success = TRUE;
+
+ out:
+  glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+  wlr_egl_unset_current (self->egl);
+
+  return success;
+}
+
+
+void
+phoc_render_readback_free (PhocRenderReadback *self)
+{
+  if (wlr_egl_make_current (self->egl)) {
+    glDeleteSync (self->fence);
+    glDeleteBuffers (1, &self->pbo);
+    wlr_egl_unset_current (self->egl);
+  }
+
+  g_free (self);
+}
+
+/**
+ * phoc_renderer_render_view_to_buffer:
+ * @self: The renderer
+ * @view: The view to render
+ * @shm_buffer: The buffer to render into
+ * @damage: (nullable): The area of @shm_buffer to update
+ *
+ * Renders a view's surfaces scaled to the size of @shm_buffer. If
+ * @damage is given only that part of the buffer is updated, the rest
+ * is left untouched.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+phoc_renderer_render_view_to_buffer (PhocRenderer            *self,
+                                     PhocView                *view,
+                                     struct wlr_buffer       *shm_buffer,
+                                     const pixman_region32_t *damage)
 {
   /* Do not use wlr_allocator on android */
   if (wlr_renderer_is_android(self->wlr_renderer))
@@ -578,16 +947,9 @@ phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
   int32_t width = shm_buffer->width;
   int32_t height = shm_buffer->height;
 
-  struct wlr_drm_format_set fmt_set = {};
-  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
-
-  const struct wlr_drm_format *fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
-
-  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
-  if (!buffer) {
-    wlr_drm_format_set_finish (&fmt_set);
+  buffer = acquire_render_target (self, width, height);
+  if (!buffer)
     g_return_val_if_reached (false);
-  }
 
   struct view_render_data render_data = {
     .view = view,
@@ -595,22 +957,40 @@ phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
     .height = height
   };
 
-  wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer);
-  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
-  wlr_surface_for_each_surface (surface, view_render_to_buffer_iterator, &render_data);
-
   if (!wlr_buffer_begin_data_ptr_access (shm_buffer,
                                          WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
                                          &data, &format, &stride)) {
+    release_render_target (self, buffer);
     return false;
   }
 
-  wlr_renderer_read_pixels (self->wlr_renderer,
-                            DRM_FORMAT_ARGB8888, stride, width, height, 0, 0, 0, 0, data);
+  wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer);
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+  wlr_surface_for_each_surface (surface, view_render_to_buffer_iterator, &render_data);
+
+  if (damage) {
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles ((pixman_region32_t *)damage, &nrects);
+
+    for (int i = 0; i < nrects; i++) {
+      int x = CLAMP (rects[i].x1, 0, width);
+      int y = CLAMP (rects[i].y1, 0, height);
+      int w = CLAMP (rects[i].x2, 0, width) - x;
+      int h = CLAMP (rects[i].y2, 0, height) - y;
+
+      if (w <= 0 || h <= 0)
+        continue;
+
+      wlr_renderer_read_pixels (self->wlr_renderer,
+                                DRM_FORMAT_ARGB8888, stride, w, h, x, y, x, y, data);
+    }
+  } else {
+    wlr_renderer_read_pixels (self->wlr_renderer,
+                              DRM_FORMAT_ARGB8888, stride, width, height, 0, 0, 0, 0, data);
+  }
   wlr_renderer_end (self->wlr_renderer);
 
-  wlr_buffer_drop (buffer);
-  wlr_drm_format_set_finish (&fmt_set);
+  release_render_target (self, buffer);
 
   wlr_buffer_end_data_ptr_access (shm_buffer);
 
@@ -618,6 +998,180 @@ phoc_renderer_render_view_to_buffer (PhocRenderer      *self,
 }
 
 
+static void
+collect_surface_iterator (PhocOutput         *output,
+                          struct wlr_surface *surface,
+                          struct wlr_box     *box,
+                          float               scale,
+                          void               *data)
+{
+  struct scene_collect_data *collect = data;
+  PhocSceneSurface scene_surface;
+
+  if (!wlr_surface_get_texture (surface))
+    return;
+
+  if (is_offloaded (collect->self, surface))
+    return;
+
+  scene_surface = (PhocSceneSurface) {
+    .surface = surface,
+    .box = *box,
+    .scale = scale,
+    .alpha = collect->alpha,
+    .offloadable = collect->offloadable,
+  };
+  pixman_region32_init (&scene_surface.damage);
+
+  g_array_append_val (collect->self->scene, scene_surface);
+}
+
+
+static void
+collect_view (PhocOutput *output, PhocView *view, struct scene_collect_data *collect)
+{
+  if (phoc_view_is_fullscreen (view) && phoc_view_get_fullscreen_output (view) != output)
+    return;
+
+  collect->alpha = phoc_view_get_alpha (view);
+  collect->offloadable = FALSE;
+  phoc_output_view_for_each_surface (output, view, collect_surface_iterator, collect);
+}
+
+
+static void
+collect_layer (PhocOutput                     *output,
+               enum zwlr_layer_shell_v1_layer  layer,
+               struct scene_collect_data      *collect)
+{
+  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, layer);
+
+  /* Panels and the OSK sit above everything else so they can go on a plane */
+  collect->offloadable = (layer == ZWLR_LAYER_SHELL_V1_LAYER_TOP ||
+                          layer == ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+
+  for (GList *l = layer_surfaces->head; l; l = l->next) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+
+    collect->alpha = phoc_layer_surface_get_alpha (layer_surface);
+    phoc_output_layer_surface_for_each_surface (output,
+                                                layer_surface,
+                                                collect_surface_iterator,
+                                                collect);
+  }
+}
+
+/*
+ * Collect all surfaces in the same back to front order
+ * phoc_renderer_render_output() paints them.
+ */
+static void
+collect_scene (PhocRenderer *self, PhocOutput *output)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
+  struct scene_collect_data collect = { .self = self, .alpha = 1.0 };
+
+  if (output->fullscreen_view != NULL) {
+    PhocView *view = output->fullscreen_view;
+
+    collect_view (output, view, &collect);
+#ifdef PHOC_XWAYLAND
+    if (PHOC_IS_XWAYLAND_SURFACE (view)) {
+      struct wlr_xwayland_surface *xsurface =
+        phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
+      collect.offloadable = FALSE;
+      phoc_output_xwayland_children_for_each_surface (output,
+                                                      xsurface,
+                                                      collect_surface_iterator,
+                                                      &collect);
+    }
+#endif
+    if (phoc_output_has_shell_revealed (output))
+      collect_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_TOP, &collect);
+  } else {
+    collect_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, &collect);
+    collect_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, &collect);
+
+    for (GList *l = phoc_desktop_get_views (desktop)->tail; l; l = l->prev) {
+      PhocView *view = PHOC_VIEW (l->data);
+
+      if (phoc_desktop_view_is_visible (desktop, view))
+        collect_view (output, view, &collect);
+    }
+    collect_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_TOP, &collect);
+  }
+
+  collect.alpha = 1.0;
+  collect.offloadable = TRUE;
+  phoc_output_drag_icons_for_each_surface (output, phoc_server_get_input (server),
+                                           collect_surface_iterator, &collect);
+
+  collect_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, &collect);
+}
+
+/**
+ * cull_occluded:
+ * @self: The renderer
+ * @ctx: The render context
+ * @occluded: (out): The area covered by opaque surfaces
+ *
+ * Walks the scene front to back and removes the area covered by
+ * opaque surfaces from the damage of every surface behind them. The
+ * resulting per surface damage is used as clip when painting back to
+ * front so hidden areas are never blended.
+ */
+static void
+cull_occluded (PhocRenderer *self, PhocRenderContext *ctx, pixman_region32_t *occluded)
+{
+  float output_scale = ctx->output->wlr_output->scale;
+
+  collect_scene (self, ctx->output);
+
+  for (int i = (int)self->scene->len - 1; i >= 0; i--) {
+    PhocSceneSurface *scene_surface = &g_array_index (self->scene, PhocSceneSurface, i);
+    struct wlr_box dst_box = scene_surface->box;
+    pixman_region32_t opaque;
+
+    phoc_utils_scale_box (&dst_box, scene_surface->scale);
+    phoc_utils_scale_box (&dst_box, output_scale);
+
+    pixman_region32_union_rect (&scene_surface->damage, &scene_surface->damage,
+                                dst_box.x, dst_box.y, dst_box.width, dst_box.height);
+    pixman_region32_intersect (&scene_surface->damage, &scene_surface->damage, ctx->damage);
+    pixman_region32_subtract (&scene_surface->damage, &scene_surface->damage, occluded);
+    g_hash_table_insert (self->surface_damage, scene_surface->surface, scene_surface);
+
+    if (scene_surface->alpha < 1.0f)
+      continue;
+
+    phoc_utils_get_opaque_region (&scene_surface->surface->opaque_region,
+                                  &scene_surface->box,
+                                  scene_surface->scale * output_scale,
+                                  &opaque);
+    pixman_region32_intersect_rect (&opaque, &opaque,
+                                    dst_box.x, dst_box.y, dst_box.width, dst_box.height);
+    pixman_region32_union (occluded, occluded, &opaque);
+    pixman_region32_fini (&opaque);
+  }
+}
+
+
+static void
+clear_scene (PhocRenderer *self)
+{
+  g_hash_table_remove_all (self->surface_damage);
+  g_array_set_size (self->scene, 0);
+}
+
+
+static void
+phoc_scene_surface_clear (PhocSceneSurface *scene_surface)
+{
+  pixman_region32_fini (&scene_surface->damage);
+}
+
+
 static void
 render_damage (PhocRenderer *self, PhocRenderContext *ctx)
 {
@@ -672,11 +1226,13 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
   struct wlr_output *wlr_output = output->wlr_output;
   PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
   pixman_region32_t *damage = ctx->damage;
-  pixman_region32_t transformed_damage;
+  pixman_region32_t transformed_damage, occluded, background;
 
   g_assert (PHOC_IS_RENDERER (self));
 
   pixman_region32_init (&transformed_damage);
+  pixman_region32_init (&occluded);
+  pixman_region32_init (&background);
 
   if (!pixman_region32_not_empty (damage)) {
     // Output isn't damaged but needs buffer swap
@@ -687,12 +1243,20 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
   phoc_output_transform_damage (output, &transformed_damage);
   wlr_output_handle_damage(wlr_output, &transformed_damage);
 
-  wlr_render_pass_add_rect (ctx->render_pass,
-                            &(struct wlr_render_rect_options){
-                              .box = { .width = wlr_output->width, .height = wlr_output->height },
-                              .color = COLOR_BLACK,
-                              .clip = &transformed_damage,
-                            });
+  cull_occluded (self, ctx, &occluded);
+
+  // Only clear what isn't covered by opaque surfaces anyway
+  pixman_region32_subtract (&background, damage, &occluded);
+  phoc_output_transform_damage (output, &background);
+  if (pixman_region32_not_empty (&background)) {
+    ctx->n_draws++;
+    wlr_render_pass_add_rect (ctx->render_pass,
+                              &(struct wlr_render_rect_options){
+                                .box = { .width = wlr_output->width, .height = wlr_output->height },
+                                .color = COLOR_BLACK,
+                                .clip = &background,
+                              });
+  }
 
   // If a view is fullscreen on this output, render it
   if (output->fullscreen_view != NULL) {
@@ -738,6 +1302,9 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
   render_layer (ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, ctx);
 
  renderer_end:
+  clear_scene (self);
+  pixman_region32_fini (&background);
+  pixman_region32_fini (&occluded);
   pixman_region32_fini (&transformed_damage);
   wlr_output_add_software_cursors_to_render_pass (wlr_output, ctx->render_pass, damage);
 
@@ -751,6 +1318,235 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
 }
 
 
+/**
+ * phoc_renderer_find_scanout_surface:
+ * @self: The renderer
+ * @output: The output to look at
+ * @status: (out): Why no surface can be scanned out
+ *
+ * Looks for a single surface that makes up all of the output's visible
+ * content so its buffer can be committed to the output without
+ * compositing. Surfaces that are fully transparent are ignored and
+ * surfaces behind an opaque surface covering the whole output are
+ * occluded, so e.g. a maximized view without any visible layer
+ * surfaces qualifies.
+ *
+ * Returns:(nullable): The surface suitable for direct scanout
+ */
+struct wlr_surface *
+phoc_renderer_find_scanout_surface (PhocRenderer      *self,
+                                    PhocOutput        *output,
+                                    PhocOutputScanout *status)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_output *wlr_output = output->wlr_output;
+  PhocSceneSurface *candidate = NULL;
+  struct wlr_surface *surface = NULL;
+  gboolean has_background = FALSE;
+  struct wlr_box dst_box;
+  struct wlr_fbox src_box;
+  int width, height;
+
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (status);
+
+  if (G_UNLIKELY (phoc_server_check_debug_flags (server,
+                                                 PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING |
+                                                 PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS))) {
+    *status = PHOC_OUTPUT_SCANOUT_DEBUG;
+    return NULL;
+  }
+
+  /* The renderer is shared so only look at what renders on this output */
+  if (phoc_output_has_overlays (output)) {
+    *status = PHOC_OUTPUT_SCANOUT_RENDER_END;
+    return NULL;
+  }
+
+  collect_scene (self, output);
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+
+  for (int i = (int)self->scene->len - 1; i >= 0; i--) {
+    PhocSceneSurface *scene_surface = &g_array_index (self->scene, PhocSceneSurface, i);
+    struct wlr_box output_box = { .width = width, .height = height };
+    struct wlr_box visible_box;
+
+    if (G_APPROX_VALUE (scene_surface->alpha, 0.0, FLT_EPSILON))
+      continue;
+
+    /* Skip surfaces without content on this output, e.g. layer
+     * surfaces slid out of view or without a size yet */
+    dst_box = scene_surface->box;
+    phoc_utils_scale_box (&dst_box, scene_surface->scale);
+    phoc_utils_scale_box (&dst_box, wlr_output->scale);
+    if (!wlr_box_intersection (&visible_box, &dst_box, &output_box))
+      continue;
+
+    if (candidate == NULL) {
+      candidate = scene_surface;
+    } else {
+      has_background = TRUE;
+      break;
+    }
+  }
+
+  if (candidate == NULL) {
+    *status = PHOC_OUTPUT_SCANOUT_NO_SURFACE;
+    goto out;
+  }
+
+  if (candidate->surface->buffer == NULL) {
+    *status = PHOC_OUTPUT_SCANOUT_NO_BUFFER;
+    goto out;
+  }
+
+  dst_box = candidate->box;
+  phoc_utils_scale_box (&dst_box, candidate->scale);
+  phoc_utils_scale_box (&dst_box, wlr_output->scale);
+  if (dst_box.x != 0 || dst_box.y != 0 || dst_box.width != width || dst_box.height != height) {
+    *status = PHOC_OUTPUT_SCANOUT_NOT_COVERING;
+    goto out;
+  }
+
+  if (candidate->alpha < 1.0f) {
+    *status = PHOC_OUTPUT_SCANOUT_TRANSLUCENT;
+    goto out;
+  }
+
+  /* The black background is what the output shows anyway */
+  if (has_background &&
+      pixman_region32_contains_rectangle (&candidate->surface->opaque_region,
+                                          &(pixman_box32_t){
+                                            .x2 = candidate->surface->current.width,
+                                            .y2 = candidate->surface->current.height,
+                                          }) != PIXMAN_REGION_IN) {
+    *status = PHOC_OUTPUT_SCANOUT_TRANSLUCENT;
+    goto out;
+  }
+
+  wlr_surface_get_buffer_source_box (candidate->surface, &src_box);
+  if (!G_APPROX_VALUE (candidate->scale, 1.0, FLT_EPSILON) ||
+      (float)candidate->surface->current.scale != wlr_output->scale ||
+      candidate->surface->current.transform != wlr_output->transform ||
+      candidate->surface->buffer->base.width != wlr_output->width ||
+      candidate->surface->buffer->base.height != wlr_output->height ||
+      src_box.x != 0 || src_box.y != 0 ||
+      src_box.width != wlr_output->width || src_box.height != wlr_output->height) {
+    *status = PHOC_OUTPUT_SCANOUT_SCALE_MISMATCH;
+    goto out;
+  }
+
+  *status = PHOC_OUTPUT_SCANOUT_OK;
+  surface = candidate->surface;
+
+ out:
+  clear_scene (self);
+  return surface;
+}
+
+
+/**
+ * phoc_renderer_get_layer_candidates:
+ * @self: The renderer
+ * @output: The output to look at
+ * @surfaces: (out caller-allocates): The surfaces that could go on output layers
+ * @boxes: (out caller-allocates): Their position in output buffer coordinates
+ * @max: The size of @surfaces and @boxes
+ *
+ * Looks for the front most surfaces that can be put on output layers
+ * (hardware planes) instead of being composited. Only surfaces on the
+ * top and overlay layers and drag icons qualify. As planes stack above
+ * the composited content the candidates must form an uninterrupted run
+ * from the front of the scene.
+ *
+ * Returns: The number of candidates, front most first
+ */
+guint
+phoc_renderer_get_layer_candidates (PhocRenderer       *self,
+                                    PhocOutput         *output,
+                                    struct wlr_surface **surfaces,
+                                    struct wlr_box      *boxes,
+                                    guint                max)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  guint n = 0;
+
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (self->n_offloaded == 0);
+
+  collect_scene (self, output);
+
+  for (int i = (int)self->scene->len - 1; i >= 0 && n < max; i--) {
+    PhocSceneSurface *scene_surface = &g_array_index (self->scene, PhocSceneSurface, i);
+    struct wlr_box dst_box = scene_surface->box;
+
+    if (G_APPROX_VALUE (scene_surface->alpha, 0.0, FLT_EPSILON))
+      continue;
+
+    /* Output layers have no notion of opacity or transforms of their own */
+    if (!scene_surface->offloadable ||
+        scene_surface->surface->buffer == NULL ||
+        scene_surface->alpha < 1.0f ||
+        !G_APPROX_VALUE (scene_surface->scale, 1.0, FLT_EPSILON) ||
+        scene_surface->surface->current.transform != wlr_output->transform)
+      break;
+
+    phoc_utils_scale_box (&dst_box, wlr_output->scale);
+    if (wlr_box_empty (&dst_box))
+      break;
+
+    surfaces[n] = scene_surface->surface;
+    boxes[n] = dst_box;
+    n++;
+  }
+
+  clear_scene (self);
+  return n;
+}
+
+/**
+ * phoc_renderer_set_offloaded_surfaces:
+ * @self: The renderer
+ * @surfaces: (nullable): The surfaces the output shows on output layers
+ * @n_surfaces: The number of surfaces
+ *
+ * Sets the surfaces that aren't composited as the output being drawn
+ * puts them on output layers. Reset with `n_surfaces` 0 when done.
+ */
+void
+phoc_renderer_set_offloaded_surfaces (PhocRenderer        *self,
+                                      struct wlr_surface **surfaces,
+                                      guint                n_surfaces)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (n_surfaces <= PHOC_RENDERER_MAX_OFFLOADED);
+
+  for (guint i = 0; i < n_surfaces; i++)
+    self->offloaded[i] = surfaces[i];
+  self->n_offloaded = n_surfaces;
+}
+
+
+/**
+ * phoc_renderer_get_target_pool_stats:
+ * @self: The renderer
+ * @hits: (out) (optional): How often a pooled render target was reused
+ * @misses: (out) (optional): How often a render target had to be allocated
+ *
+ * Get statistics about the render targets used for thumbnails.
+ */
+void
+phoc_renderer_get_target_pool_stats (PhocRenderer *self, guint *hits, guint *misses)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  if (hits)
+    *hits = self->target_pool_hits;
+  if (misses)
+    *misses = self->target_pool_misses;
+}
+
+
 static gboolean
 phoc_renderer_initable_init (GInitable    *initable,
                              GCancellable *cancellable,
@@ -784,6 +1580,10 @@ phoc_renderer_finalize (GObject *object)
 {
   PhocRenderer *self = PHOC_RENDERER (object);
 
+  g_clear_handle_id (&self->target_pool_trim_id, g_source_remove);
+  g_clear_pointer (&self->target_pool, g_ptr_array_unref);
+  g_clear_pointer (&self->surface_damage, g_hash_table_destroy);
+  g_clear_pointer (&self->scene, g_array_unref);
   g_clear_pointer (&self->wlr_allocator, wlr_allocator_destroy);
   g_clear_pointer (&self->wlr_renderer, wlr_renderer_destroy);
 
@@ -840,6 +1640,11 @@ phoc_renderer_class_init (PhocRendererClass *klass)
 static void
 phoc_renderer_init (PhocRenderer *self)
 {
+  self->scene = g_array_new (FALSE, FALSE, sizeof (PhocSceneSurface));
+  g_array_set_clear_func (self->scene, (GDestroyNotify)phoc_scene_surface_clear);
+  self->surface_damage = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->target_pool = g_ptr_array_new_with_free_func ((GDestroyNotify)wlr_buffer_drop);
+  self->pbo_readback = -1;
 }
 
 
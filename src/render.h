@@ -25,6 +25,7 @@ typedef struct _PhocRenderContext {
   float                       alpha;
   struct wlr_render_pass     *render_pass;
   enum wlr_scale_filter_mode  tex_filter;
+  guint                       n_draws;
 } PhocRenderContext;
 
 
@@ -33,8 +34,23 @@ PhocRenderer *phoc_renderer_new (struct wlr_backend *wlr_backend, GError **error
 void          phoc_renderer_render_output (PhocRenderer      *self,
                                            PhocOutput        *output,
                                            PhocRenderContext *context);
-gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer           *self,
-                                                   PhocView               *view,
-                                                   struct wlr_buffer      *data);
+gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer            *self,
+                                                   PhocView                *view,
+                                                   struct wlr_buffer       *data,
+                                                   const pixman_region32_t *damage);
+
+typedef struct _PhocRenderReadback PhocRenderReadback;
+
+PhocRenderReadback *phoc_renderer_start_view_readback (PhocRenderer *self,
+                                                       PhocView     *view,
+                                                       int           width,
+                                                       int           height);
+gboolean      phoc_render_readback_is_done (PhocRenderReadback *self);
+gboolean      phoc_render_readback_finish  (PhocRenderReadback      *self,
+                                            struct wlr_buffer       *shm_buffer,
+                                            const pixman_region32_t *damage);
+void          phoc_render_readback_free    (PhocRenderReadback *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocRenderReadback, phoc_render_readback_free)
 
 G_END_DECLS
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-repaint-scheduler"
+
+#include "phoc-config.h"
+
+#include "repaint-scheduler.h"
+
+/* Number of render durations the prediction is based on */
+#define PHOC_REPAINT_HISTORY_SIZE 16
+/* Time needed for the commit, the page flip and timer slack */
+#define PHOC_REPAINT_SAFETY_MARGIN_US 1500
+/* The main loop polls with ms granularity so don't bother with shorter delays */
+#define PHOC_REPAINT_MIN_DELAY_US 1000
+/* Consecutive missed deadlines before falling back to immediate repaints */
+#define PHOC_REPAINT_MAX_MISSED 3
+/* Number of immediate repaints before delaying again */
+#define PHOC_REPAINT_FALLBACK_FRAMES 120
+
+/**
+ * PhocRepaintScheduler:
+ *
+ * Predicts how long an output takes to render a frame based on the
+ * most recent render durations. This allows to delay the repaint
+ * after the output's frame event to just before the next vblank
+ * deadline, so client commits arriving in between still make it into
+ * the frame.
+ *
+ * The delay is capped at three quarters of the refresh period. Whether
+ * a delayed frame made its deadline is judged by when it actually got
+ * presented. If delayed frames repeatedly miss their deadline the
+ * scheduler falls back to repainting immediately for a while.
+ */
+struct _PhocRepaintScheduler {
+  gint64                    render_us[PHOC_REPAINT_HISTORY_SIZE];
+  guint                     head;
+  guint                     n_render;
+
+  gboolean                  delayed;
+  gint64                    frame_us;
+  guint                     n_consecutive_missed;
+  guint                     fallback_frames;
+
+  PhocRepaintSchedulerStats stats;
+};
+
+/**
+ * phoc_repaint_scheduler_new:
+ *
+ * Returns: (transfer full): A new repaint scheduler
+ */
+PhocRepaintScheduler *
+phoc_repaint_scheduler_new (void)
+{
+  return g_new0 (PhocRepaintScheduler, 1);
+}
+
+
+void
+phoc_repaint_scheduler_free (PhocRepaintScheduler *self)
+{
+  g_free (self);
+}
+
+
+static gint64
+predict_render_us (PhocRepaintScheduler *self)
+{
+  gint64 predicted = 0;
+
+  /* Be pessimistic, a missed frame is worse than a bit of latency */
+  for (guint i = 0; i < self->n_render; i++)
+    predicted = MAX (predicted, self->render_us[i]);
+
+  return predicted;
+}
+
+/**
+ * phoc_repaint_scheduler_get_delay:
+ * @self: The repaint scheduler
+ * @frame_us: When the output's frame event fired
+ * @period_us: The output's refresh period or `0` if unknown
+ *
+ * Get the delay for the repaint of the current frame. Invoke this when
+ * the output's frame event fires.
+ *
+ * Returns: The delay in microseconds or `0` to repaint immediately
+ */
+gint64
+phoc_repaint_scheduler_get_delay (PhocRepaintScheduler *self, gint64 frame_us, gint64 period_us)
+{
+  gint64 delay_us;
+
+  self->stats.n_frames++;
+  self->stats.last_delay_us = 0;
+  self->delayed = FALSE;
+  self->frame_us = frame_us;
+
+  if (period_us <= 0)
+    return 0;
+
+  if (self->fallback_frames) {
+    self->fallback_frames--;
+    return 0;
+  }
+
+  /* No prediction possible yet */
+  if (self->n_render == 0)
+    return 0;
+
+  self->stats.predicted_us = predict_render_us (self);
+  delay_us = period_us - self->stats.predicted_us - PHOC_REPAINT_SAFETY_MARGIN_US;
+  delay_us = MIN (delay_us, period_us * 3 / 4);
+  if (delay_us < PHOC_REPAINT_MIN_DELAY_US)
+    return 0;
+
+  self->delayed = TRUE;
+  self->stats.n_delayed++;
+  self->stats.last_delay_us = delay_us;
+
+  return delay_us;
+}
+
+/**
+ * phoc_repaint_scheduler_frame_done:
+ * @self: The repaint scheduler
+ * @render_us: How long rendering the frame took, including the submission
+ *   of the render pass
+ *
+ * Feed back the render duration of a committed frame so future delays
+ * can be predicted.
+ */
+void
+phoc_repaint_scheduler_frame_done (PhocRepaintScheduler *self, gint64 render_us)
+{
+  self->render_us[self->head] = render_us;
+  self->head = (self->head + 1) % PHOC_REPAINT_HISTORY_SIZE;
+  self->n_render = MIN (self->n_render + 1, PHOC_REPAINT_HISTORY_SIZE);
+}
+
+/**
+ * phoc_repaint_scheduler_presented:
+ * @self: The repaint scheduler
+ * @present_us: When the committed frame got presented
+ * @period_us: The output's refresh period or `0` if unknown
+ *
+ * Feed back when the most recently committed frame got presented. A
+ * delayed frame missed its deadline if it wasn't presented on the first
+ * vblank after the frame event. As the frame event fires shortly after
+ * a vblank, half a period of slack keeps jitter from counting as a miss.
+ */
+void
+phoc_repaint_scheduler_presented (PhocRepaintScheduler *self,
+                                  gint64                present_us,
+                                  gint64                period_us)
+{
+  if (!self->delayed || period_us <= 0)
+    return;
+
+  self->delayed = FALSE;
+
+  if (present_us <= self->frame_us + period_us + period_us / 2) {
+    self->n_consecutive_missed = 0;
+    return;
+  }
+
+  self->stats.n_missed++;
+  self->n_consecutive_missed++;
+  if (self->n_consecutive_missed < PHOC_REPAINT_MAX_MISSED)
+    return;
+
+  g_debug ("Missed %u deadlines in a row, repainting immediately for %u frames",
+           self->n_consecutive_missed, PHOC_REPAINT_FALLBACK_FRAMES);
+  self->n_consecutive_missed = 0;
+  self->fallback_frames = PHOC_REPAINT_FALLBACK_FRAMES;
+  self->stats.n_fallbacks++;
+}
+
+/**
+ * phoc_repaint_scheduler_get_stats:
+ * @self: The repaint scheduler
+ * @stats: (out): The statistics
+ *
+ * Get the scheduler's statistics.
+ */
+void
+phoc_repaint_scheduler_get_stats (PhocRepaintScheduler *self, PhocRepaintSchedulerStats *stats)
+{
+  *stats = self->stats;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * PhocRepaintSchedulerStats:
+ * @n_frames: Number of frames scheduled
+ * @n_delayed: Number of frames whose repaint got delayed
+ * @n_missed: Number of delayed frames that missed their deadline
+ * @n_fallbacks: Number of times the scheduler fell back to immediate repaints
+ * @predicted_us: The currently predicted render duration
+ * @last_delay_us: The delay used for the most recent frame
+ *
+ * Statistics of a [struct@RepaintScheduler].
+ */
+typedef struct _PhocRepaintSchedulerStats {
+  guint64 n_frames;
+  guint64 n_delayed;
+  guint64 n_missed;
+  guint64 n_fallbacks;
+  gint64  predicted_us;
+  gint64  last_delay_us;
+} PhocRepaintSchedulerStats;
+
+typedef struct _PhocRepaintScheduler PhocRepaintScheduler;
+
+PhocRepaintScheduler *phoc_repaint_scheduler_new        (void);
+void                  phoc_repaint_scheduler_free       (PhocRepaintScheduler *self);
+gint64                phoc_repaint_scheduler_get_delay  (PhocRepaintScheduler *self,
+                                                         gint64                frame_us,
+                                                         gint64                period_us);
+void                  phoc_repaint_scheduler_frame_done (PhocRepaintScheduler *self,
+                                                         gint64                render_us);
+void                  phoc_repaint_scheduler_presented  (PhocRepaintScheduler *self,
+                                                         gint64                present_us,
+                                                         gint64                period_us);
+void                  phoc_repaint_scheduler_get_stats  (PhocRepaintScheduler      *self,
+                                                         PhocRepaintSchedulerStats *stats);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocRepaintScheduler, phoc_repaint_scheduler_free)
+
+G_END_DECLS
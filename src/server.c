@@ -53,6 +53,7 @@ typedef struct _PhocServer {
 
   PhocRenderer        *renderer;
   PhocDesktop         *desktop;
+  PhocKeymapCache     *keymap_cache;
 
   gchar               *session_exec;
   gint                 exit_status;
@@ -361,6 +362,7 @@ phoc_server_finalize (GObject *object)
   g_clear_handle_id (&self->wl_source, g_source_remove);
   g_clear_object (&self->input);
   g_clear_object (&self->desktop);
+  g_clear_object (&self->keymap_cache);
   g_clear_pointer (&self->session_exec, g_free);
 
   if (self->inited) {
@@ -391,6 +393,7 @@ phoc_server_init (PhocServer *self)
   g_autoptr (GError) err = NULL;
 
   self->dt_compatibles = gm_device_tree_get_compatibles (NULL, &err);
+  self->keymap_cache = phoc_keymap_cache_new ();
 }
 
 /**
@@ -536,6 +539,22 @@ phoc_server_get_renderer (PhocServer *self)
   return self->renderer;
 }
 
+/**
+ * phoc_server_get_keymap_cache:
+ * @self: The server
+ *
+ * Gets the keymap cache shared by all keyboards
+ *
+ * Returns: (transfer none): The keymap cache
+ */
+PhocKeymapCache *
+phoc_server_get_keymap_cache (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->keymap_cache;
+}
+
 /**
  * phoc_server_get_desktop:
  * @self: The server
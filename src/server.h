@@ -11,6 +11,7 @@
 
 #include "desktop.h"
 #include "input.h"
+#include "keymap-cache.h"
 #include "render.h"
 #include "settings.h"
 
@@ -47,6 +48,8 @@ typedef enum _PhocServerDebugFlags {
   PHOC_SERVER_DEBUG_FLAG_LAYER_SHELL        = 1 << 4,
   PHOC_SERVER_DEBUG_FLAG_CUTOUTS            = 1 << 5,
   PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS = 1 << 6,
+  PHOC_SERVER_DEBUG_FLAG_FRAME_TIMINGS      = 1 << 7,
+  PHOC_SERVER_DEBUG_FLAG_FRAME_THROTTLE     = 1 << 8,
 } PhocServerDebugFlags;
 
 
@@ -62,6 +65,7 @@ gboolean               phoc_server_check_debug_flags       (PhocServer *self,
 const char            *phoc_server_get_session_exec        (PhocServer *self);
 gint                   phoc_server_get_session_exit_status (PhocServer *self);
 PhocRenderer          *phoc_server_get_renderer            (PhocServer *self);
+PhocKeymapCache       *phoc_server_get_keymap_cache        (PhocServer *self);
 PhocDesktop           *phoc_server_get_desktop             (PhocServer *self);
 PhocInput             *phoc_server_get_input               (PhocServer *self);
 PhocConfig            *phoc_server_get_config              (PhocServer *self);
@@ -220,6 +220,14 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       oc->scale_filter = parse_scale_filter (value);
     } else if (strcmp (name, "drm-panel-orientation") == 0) {
       oc->drm_panel_orientation = parse_boolean (value, true);
+    } else if (strcmp (name, "adaptive-sync") == 0) {
+      oc->adaptive_sync = parse_boolean (value, false);
+    } else if (strcmp (name, "low-refresh-rate") == 0) {
+      oc->low_refresh_rate = strtof (value, NULL);
+      if (oc->low_refresh_rate < 0) {
+        g_critical ("Invalid low refresh rate: %s", value);
+        oc->low_refresh_rate = 0;
+      }
     } else if (g_str_equal (name, "phys_width")) {
       oc->phys_width = strtol (value, NULL, 10);
     } else if (g_str_equal (name, "phys_height")) {
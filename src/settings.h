@@ -23,6 +23,8 @@ typedef struct _PhocOutputConfig {
   float                    scale;
   PhocOutputScaleFilter    scale_filter;
   bool                     drm_panel_orientation;
+  bool                     adaptive_sync;
+  float                    low_refresh_rate;
 
   struct PhocMode {
     int   width, height;
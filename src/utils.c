@@ -175,8 +175,56 @@ phoc_utils_is_damaged (const struct wlr_box    *box,
 }
 
 
+/**
+ * phoc_utils_get_opaque_region:
+ * @opaque: A surface's opaque region in surface local coordinates
+ * @box: The surface's box in output local coordinates
+ * @scale: The scale to apply
+ * @out: (out): The opaque region in output buffer coordinates. Don't init
+ *   the pixman region `get_opaque_region` does that for you.
+ *
+ * Translates and scales a surface's opaque region into output buffer
+ * coordinates. Unlike damage the region is shrunk on fractional scales
+ * so that it never covers pixels that are only partially opaque.
+ */
 void
-phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface)
+phoc_utils_get_opaque_region (const pixman_region32_t *opaque,
+                              const struct wlr_box    *box,
+                              float                    scale,
+                              pixman_region32_t       *out)
+{
+  const pixman_box32_t *rects;
+  int nrects;
+
+  pixman_region32_init (out);
+
+  rects = pixman_region32_rectangles (opaque, &nrects);
+  for (int i = 0; i < nrects; i++) {
+    int x1 = ceil ((box->x + rects[i].x1) * scale);
+    int y1 = ceil ((box->y + rects[i].y1) * scale);
+    int x2 = floor ((box->x + rects[i].x2) * scale);
+    int y2 = floor ((box->y + rects[i].y2) * scale);
+
+    if (x2 <= x1 || y2 <= y1)
+      continue;
+
+    pixman_region32_union_rect (out, out, x1, y1, x2 - x1, y2 - y1);
+  }
+}
+
+
+/**
+ * phoc_utils_wlr_surface_update_scales_full:
+ * @surface: The surface
+ * @view_scale: The scale the compositor applies to the surface when rendering
+ *
+ * Update the surface's preferred scales based on the outputs it's
+ * on. The preferred scale includes @view_scale so clients supporting
+ * fractional scaling render their buffers at the size they end up on
+ * screen and the compositor doesn't need to resample them.
+ */
+void
+phoc_utils_wlr_surface_update_scales_full (struct wlr_surface *surface, float view_scale)
 {
   float scale = 1.0;
 
@@ -186,24 +234,50 @@ phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface)
       scale = surface_output->output->scale;
   }
 
+  scale *= view_scale;
   wlr_fractional_scale_v1_notify_scale (surface, scale);
   wlr_surface_set_preferred_buffer_scale (surface, ceil (scale));
 }
 
 
 void
-phoc_utils_wlr_surface_enter_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface)
+{
+  phoc_utils_wlr_surface_update_scales_full (surface, 1.0);
+}
+
+
+void
+phoc_utils_wlr_surface_enter_output_full (struct wlr_surface *wlr_surface,
+                                          struct wlr_output  *wlr_output,
+                                          float               view_scale)
 {
   wlr_surface_send_enter (wlr_surface, wlr_output);
 
-  phoc_utils_wlr_surface_update_scales (wlr_surface);
+  phoc_utils_wlr_surface_update_scales_full (wlr_surface, view_scale);
 }
 
 
 void
-phoc_utils_wlr_surface_leave_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+phoc_utils_wlr_surface_enter_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+{
+  phoc_utils_wlr_surface_enter_output_full (wlr_surface, wlr_output, 1.0);
+}
+
+
+void
+phoc_utils_wlr_surface_leave_output_full (struct wlr_surface *wlr_surface,
+                                          struct wlr_output  *wlr_output,
+                                          float               view_scale)
 {
   wlr_surface_send_leave (wlr_surface, wlr_output);
 
-  phoc_utils_wlr_surface_update_scales (wlr_surface);
+  phoc_utils_wlr_surface_update_scales_full (wlr_surface, view_scale);
+}
+
+
+void
+phoc_utils_wlr_surface_leave_output (struct wlr_surface *wlr_surface, struct wlr_output *wlr_output)
+{
+  phoc_utils_wlr_surface_leave_output_full (wlr_surface, wlr_output, 1.0);
 }
@@ -43,12 +43,24 @@ gboolean   phoc_utils_is_damaged            (const struct wlr_box    *box,
                                              const pixman_region32_t *damage,
                                              const struct wlr_box    *clip_box,
                                              pixman_region32_t       *out_damage);
+void       phoc_utils_get_opaque_region     (const pixman_region32_t *opaque,
+                                             const struct wlr_box    *box,
+                                             float                    scale,
+                                             pixman_region32_t       *out);
 
 void       phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface);
+void       phoc_utils_wlr_surface_update_scales_full (struct wlr_surface *surface,
+                                                      float               view_scale);
 void       phoc_utils_wlr_surface_enter_output  (struct wlr_surface *wlr_surface,
                                                  struct wlr_output  *wlr_output);
+void       phoc_utils_wlr_surface_enter_output_full (struct wlr_surface *wlr_surface,
+                                                     struct wlr_output  *wlr_output,
+                                                     float               view_scale);
 void       phoc_utils_wlr_surface_leave_output  (struct wlr_surface *wlr_surface,
                                                  struct wlr_output  *wlr_output);
+void       phoc_utils_wlr_surface_leave_output_full (struct wlr_surface *wlr_surface,
+                                                     struct wlr_output  *wlr_output,
+                                                     float               view_scale);
 
 
 G_END_DECLS
@@ -232,7 +232,8 @@ phoc_view_child_map_default (PhocViewChild *self)
     bool intersects = wlr_output_layout_intersects (view->desktop->layout,
                                                     output->wlr_output, &box);
     if (intersects)
-      phoc_utils_wlr_surface_enter_output (self->wlr_surface, output->wlr_output);
+      phoc_utils_wlr_surface_enter_output_full (self->wlr_surface, output->wlr_output,
+                                                phoc_view_get_scale (view));
   }
 
   phoc_input_update_cursor_focus (input);
@@ -320,6 +321,9 @@ phoc_view_child_damage_whole (PhocViewChild *self)
   int sx, sy;
   struct wlr_box view_box;
 
+  if (self)
+    phoc_view_invalidate_input_bounds (self->view);
+
   if (!self || !phoc_view_child_is_mapped (self) || !phoc_view_is_mapped (self->view))
     return;
 
@@ -112,6 +112,7 @@ phoc_view_deco_bling_render (PhocBling *bling, PhocRenderContext *ctx)
   phoc_output_transform_damage (ctx->output, &damage);
   phoc_output_transform_box (ctx->output, &box);
 
+  ctx->n_draws++;
   wlr_render_pass_add_rect(ctx->render_pass, &(struct wlr_render_rect_options){
       .box = box,
       .color = PHOC_DECO_COLOR,
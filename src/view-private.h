@@ -10,6 +10,20 @@
 
 G_BEGIN_DECLS
 
+/*
+ * Damage of a view's surface tree in view coordinates (relative to
+ * the main surface, unscaled), collected in a single walk so it can be
+ * added to every output the view is on.
+ */
+typedef struct _PhocViewDamage {
+  bool              whole;
+  bool              frame_callbacks;
+  int               min_buffer_scale;
+  struct wlr_box    bounds;
+  pixman_region32_t damage;
+  pixman_region32_t surface_damage;
+} PhocViewDamage;
+
 /* Functions to be used by derived classes only */
 void             view_set_title                      (PhocView *self, const char *title);
 void             view_set_parent                     (PhocView *self, PhocView *parent);
@@ -21,5 +35,7 @@ void             phoc_view_set_initial_focus         (PhocView *self);
 void             phoc_view_map                       (PhocView *self, struct wlr_surface *surface);
 void             phoc_view_unmap                     (PhocView *self);
 void             phoc_view_apply_damage              (PhocView *self);
+void             phoc_view_invalidate_input_bounds   (PhocView *self);
+void             phoc_view_update_frame_throttle     (PhocView *self);
 
 G_END_DECLS
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <wlr/types/wlr_subcompositor.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/box.h>
 #include "bling.h"
 #include "cursor.h"
 #include "view-deco.h"
@@ -24,6 +25,7 @@
 
 #define PHOC_ANIM_DURATION_WINDOW_FADE 150
 #define PHOC_MOVE_TO_CORNER_MARGIN 12
+#define PHOC_VIEW_THROTTLED_FRAME_INTERVAL_MS 1000
 
 enum {
   PROP_0,
@@ -37,6 +39,7 @@ static GParamSpec *props[PROP_LAST_PROP];
 
 enum {
   SURFACE_DESTROY,
+  CONTENT_DAMAGED,
   N_SIGNALS
 };
 static guint signals[N_SIGNALS] = { 0 };
@@ -49,6 +52,7 @@ typedef struct _PhocViewPrivate {
 
   float          alpha;
   float          scale;
+  PhocViewScalePath scale_path;
   PhocViewDeco  *deco;
   PhocViewState  state;
   PhocViewTileDirection tile_direction;
@@ -72,12 +76,21 @@ typedef struct _PhocViewPrivate {
   /* Subsurface and popups */
   struct wl_listener surface_new_subsurface;
   struct wl_list child_surfaces; // PhocViewChild::link
+
+  /* Bounding box of all surfaces in main surface coordinates */
+  struct wlr_box input_bounds;
+  gboolean       input_bounds_valid;
+
+  /* Frame callbacks when not visible */
+  gboolean       frame_throttled;
+  guint          frame_throttle_id;
 } PhocViewPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (PhocView, phoc_view, G_TYPE_OBJECT)
 #define PHOC_VIEW_SELF(p) PHOC_PRIV_CONTAINER(PHOC_VIEW, PhocView, (p))
 
 static bool view_center (PhocView *view, PhocOutput *output);
+static void view_update_scale_path (PhocView *view);
 
 
 static struct wlr_foreign_toplevel_handle_v1 *
@@ -183,21 +196,36 @@ phoc_view_get_deco_part (PhocView *self, double sx, double sy)
 }
 
 
+typedef struct {
+  struct wlr_output *wlr_output;
+  float              scale;
+} PhocViewSurfaceOutputData;
+
+
 static void
 surface_send_enter_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
 {
-  struct wlr_output *wlr_output = data;
+  PhocViewSurfaceOutputData *output_data = data;
+
+  phoc_utils_wlr_surface_enter_output_full (wlr_surface, output_data->wlr_output, output_data->scale);
+}
+
+
+static void
+surface_update_scales_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
+{
+  float *scale = data;
 
-  phoc_utils_wlr_surface_enter_output (wlr_surface, wlr_output);
+  phoc_utils_wlr_surface_update_scales_full (wlr_surface, *scale);
 }
 
 
 static void
 surface_send_leave_iterator (struct wlr_surface *wlr_surface, int x, int y, void *data)
 {
-  struct wlr_output *wlr_output = data;
+  PhocViewSurfaceOutputData *output_data = data;
 
-  phoc_utils_wlr_surface_leave_output (wlr_surface, wlr_output);
+  phoc_utils_wlr_surface_leave_output_full (wlr_surface, output_data->wlr_output, output_data->scale);
 }
 
 
@@ -215,6 +243,10 @@ view_update_output (PhocView *view, const struct wlr_box *before)
 
   PhocOutput *output;
   wl_list_for_each (output, &desktop->outputs, link) {
+    PhocViewSurfaceOutputData output_data = {
+      .wlr_output = output->wlr_output,
+      .scale = priv->scale,
+    };
     bool intersected, intersects;
 
     intersected = before && wlr_output_layout_intersects (desktop->layout,
@@ -223,18 +255,21 @@ view_update_output (PhocView *view, const struct wlr_box *before)
     intersects = wlr_output_layout_intersects (desktop->layout, output->wlr_output, &box);
 
     if (intersected && !intersects) {
-      phoc_view_for_each_surface (view, surface_send_leave_iterator, output->wlr_output);
+      phoc_view_for_each_surface (view, surface_send_leave_iterator, &output_data);
       if (priv->toplevel_handle)
         wlr_foreign_toplevel_handle_v1_output_leave (priv->toplevel_handle, output->wlr_output);
     }
 
     if (!intersected && intersects) {
-      phoc_view_for_each_surface (view, surface_send_enter_iterator, output->wlr_output);
+      phoc_view_for_each_surface (view, surface_send_enter_iterator, &output_data);
 
       if (priv->toplevel_handle)
         wlr_foreign_toplevel_handle_v1_output_enter (priv->toplevel_handle, output->wlr_output);
     }
   }
+
+  /* The output's scale determines which path the view is scaled by */
+  view_update_scale_path (view);
 }
 
 
@@ -908,8 +943,56 @@ view_update_scale (PhocView *view)
     priv->scale = 1.0;
   }
 
-  if (priv->scale != oldscale)
-    phoc_view_arrange (view, NULL, TRUE);
+  if (priv->scale == oldscale)
+    return;
+
+  /* Let clients supporting fractional scaling render at the view's
+   * scale so we don't have to downscale their buffers */
+  if (phoc_view_is_mapped (view))
+    phoc_view_for_each_surface (view, surface_update_scales_iterator, &priv->scale);
+
+  phoc_view_arrange (view, NULL, TRUE);
+}
+
+
+static void
+view_update_scale_path (PhocView *view)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
+  struct wlr_surface *surface = view->wlr_surface;
+  PhocViewScalePath scale_path;
+  PhocOutput *output;
+
+  output = phoc_view_get_output (view);
+  if (G_APPROX_VALUE (priv->scale, 1.0, FLT_EPSILON) || !output || !surface ||
+      !surface->current.buffer_width) {
+    scale_path = PHOC_VIEW_SCALE_PATH_NONE;
+  } else {
+    float scale = priv->scale * output->wlr_output->scale;
+    int width = surface->current.buffer_width;
+    int height = surface->current.buffer_height;
+
+    if (surface->current.transform & WL_OUTPUT_TRANSFORM_90) {
+      width = surface->current.buffer_height;
+      height = surface->current.buffer_width;
+    }
+
+    /* The client rendered at the target size, the buffer is shown 1:1 */
+    if (ABS (width - surface->current.width * scale) <= 1 &&
+        ABS (height - surface->current.height * scale) <= 1) {
+      scale_path = PHOC_VIEW_SCALE_PATH_CLIENT;
+    } else {
+      scale_path = PHOC_VIEW_SCALE_PATH_COMPOSITOR;
+    }
+  }
+
+  if (priv->scale_path == scale_path)
+    return;
+
+  priv->scale_path = scale_path;
+  g_debug ("View %p (%s) scale path: %s", view, priv->app_id,
+           scale_path == PHOC_VIEW_SCALE_PATH_CLIENT ? "client" :
+           scale_path == PHOC_VIEW_SCALE_PATH_COMPOSITOR ? "compositor" : "none");
 }
 
 
@@ -991,6 +1074,8 @@ phoc_view_unmap (PhocView *view)
 
   bool was_visible = phoc_desktop_view_is_visible(view->desktop, view);
 
+  g_clear_handle_id (&priv->frame_throttle_id, g_source_remove);
+  priv->frame_throttled = FALSE;
   phoc_view_damage_whole (view);
 
   wl_list_remove (&priv->surface_new_subsurface.link);
@@ -1039,12 +1124,25 @@ phoc_view_set_initial_focus (PhocView *view)
   phoc_seat_set_focus_view (seat, view);
 }
 
+static gboolean
+view_is_occluded (PhocView *view)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &view->desktop->outputs, link) {
+    if (!phoc_output_view_is_occluded (output, view))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * view_send_frame_done_if_not_visible:
  * @view: The #PhocView
  *
- * For views that aren't visible, EGL-Wayland can be stuck
- * in eglSwapBuffers waiting for frame done event. This function
+ * For views that aren't visible or are occluded, EGL-Wayland can be
+ * stuck in eglSwapBuffers waiting for frame done event. This function
  * helps it get unstuck, so further events can actually be processed
  * by the client. It's worth calling this function when sending
  * events like `configure` or `close`, as these should get processed
@@ -1053,7 +1151,10 @@ phoc_view_set_initial_focus (PhocView *view)
 void
 view_send_frame_done_if_not_visible (PhocView *view)
 {
-  if (!phoc_desktop_view_is_visible (view->desktop, view) && phoc_view_is_mapped (view)) {
+  if (!phoc_view_is_mapped (view))
+    return;
+
+  if (!phoc_desktop_view_is_visible (view->desktop, view) || view_is_occluded (view)) {
     struct timespec now;
     clock_gettime (CLOCK_MONOTONIC, &now);
     wlr_surface_send_frame_done (view->wlr_surface, &now);
@@ -1097,6 +1198,170 @@ phoc_view_setup (PhocView *view)
   wlr_foreign_toplevel_handle_v1_set_parent (priv->toplevel_handle, toplevel_handle);
 }
 
+static void
+content_damage_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  pixman_region32_t *content_damage = data;
+  pixman_region32_t damage;
+
+  pixman_region32_init (&damage);
+  wlr_surface_get_effective_damage (surface, &damage);
+  pixman_region32_translate (&damage, sx, sy);
+  pixman_region32_union (content_damage, content_damage, &damage);
+  pixman_region32_fini (&damage);
+}
+
+
+static void
+emit_content_damaged (PhocView *self)
+{
+  pixman_region32_t damage;
+
+  if (G_LIKELY (!g_signal_has_handler_pending (self, signals[CONTENT_DAMAGED], 0, FALSE)))
+    return;
+
+  if (self->wlr_surface == NULL)
+    return;
+
+  pixman_region32_init (&damage);
+  wlr_surface_for_each_surface (self->wlr_surface, content_damage_iterator, &damage);
+  if (pixman_region32_not_empty (&damage))
+    g_signal_emit (self, signals[CONTENT_DAMAGED], 0, &damage);
+  pixman_region32_fini (&damage);
+}
+
+static void
+send_frame_done_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  struct timespec *when = data;
+
+  wlr_surface_send_frame_done (surface, when);
+}
+
+
+static void
+has_frame_callbacks_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  gboolean *has_callbacks = data;
+
+  if (!wl_list_empty (&surface->current.frame_callback_list))
+    *has_callbacks = TRUE;
+}
+
+
+static gboolean
+on_frame_throttle_timeout (gpointer data)
+{
+  PhocView *self = PHOC_VIEW (data);
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  struct timespec now;
+
+  priv->frame_throttle_id = 0;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  phoc_view_for_each_surface (self, send_frame_done_iterator, &now);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_view_update_frame_throttle:
+ * @self: The view
+ *
+ * Views that aren't visible on any output don't get frame callbacks
+ * from the outputs' frame handlers. Send them at a reduced rate
+ * instead so clients make progress without burning CPU. The timer is
+ * only armed when a throttled view has pending frame callbacks so idle
+ * clients don't cause wakeups.
+ */
+void
+phoc_view_update_frame_throttle (PhocView *self)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  PhocServer *server = phoc_server_get_default ();
+  gboolean throttled, has_callbacks = FALSE;
+
+  throttled = !phoc_desktop_view_is_visible (self->desktop, self) || view_is_occluded (self);
+
+  if (throttled != priv->frame_throttled) {
+    priv->frame_throttled = throttled;
+
+    if (G_UNLIKELY (phoc_server_check_debug_flags (server,
+                                                   PHOC_SERVER_DEBUG_FLAG_FRAME_THROTTLE))) {
+      g_message ("View %p (%s): Frame callbacks at %s", self,
+                 phoc_view_get_app_id (self) ?: "unknown",
+                 throttled ? "1 Hz" : "output refresh rate");
+    }
+  }
+
+  if (!throttled) {
+    g_clear_handle_id (&priv->frame_throttle_id, g_source_remove);
+    return;
+  }
+
+  if (priv->frame_throttle_id)
+    return;
+
+  phoc_view_for_each_surface (self, has_frame_callbacks_iterator, &has_callbacks);
+  if (!has_callbacks)
+    return;
+
+  priv->frame_throttle_id = g_timeout_add (PHOC_VIEW_THROTTLED_FRAME_INTERVAL_MS,
+                                           on_frame_throttle_timeout, self);
+  g_source_set_name_by_id (priv->frame_throttle_id, "[phoc] view frame throttle");
+}
+
+static void input_bounds_iterator (struct wlr_surface *surface, int sx, int sy, void *data);
+
+
+static void
+collect_damage_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  PhocViewDamage *damage = data;
+  pixman_region32_t *surface_damage = &damage->surface_damage;
+
+  /* Build the bounds in the same pass so they don't need another walk */
+  input_bounds_iterator (surface, sx, sy, &damage->bounds);
+
+  if (!wlr_surface_has_buffer (surface))
+    return;
+
+  damage->min_buffer_scale = MIN (damage->min_buffer_scale, surface->current.scale);
+
+  wlr_surface_get_effective_damage (surface, surface_damage);
+  pixman_region32_translate (surface_damage, sx, sy);
+  pixman_region32_union (&damage->damage, &damage->damage, surface_damage);
+
+  if (damage->whole)
+    pixman_region32_union_rect (&damage->damage, &damage->damage, sx, sy,
+                                surface->current.width, surface->current.height);
+
+  if (!wl_list_empty (&surface->current.frame_callback_list))
+    damage->frame_callbacks = true;
+}
+
+
+static void
+view_damage (PhocView *self, bool whole)
+{
+  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  PhocViewDamage damage = { .whole = whole, .min_buffer_scale = G_MAXINT };
+  PhocOutput *output;
+
+  pixman_region32_init (&damage.damage);
+  pixman_region32_init (&damage.surface_damage);
+
+  phoc_view_for_each_surface (self, collect_damage_iterator, &damage);
+  priv->input_bounds = damage.bounds;
+  priv->input_bounds_valid = TRUE;
+
+  wl_list_for_each (output, &self->desktop->outputs, link)
+    phoc_output_damage_from_view (output, self, &damage);
+
+  pixman_region32_fini (&damage.surface_damage);
+  pixman_region32_fini (&damage.damage);
+}
+
 /**
  * phoc_view_apply_damage:
  * @view: A view
@@ -1107,10 +1372,11 @@ phoc_view_setup (PhocView *view)
 void
 phoc_view_apply_damage (PhocView *view)
 {
-  PhocOutput *output;
+  view_damage (view, false);
 
-  wl_list_for_each (output, &view->desktop->outputs, link)
-    phoc_output_damage_from_view (output, view, false);
+  view_update_scale_path (view);
+  phoc_view_update_frame_throttle (view);
+  emit_content_damaged (view);
 }
 
 /**
@@ -1125,9 +1391,7 @@ phoc_view_apply_damage (PhocView *view)
 void
 phoc_view_damage_whole (PhocView *view)
 {
-  PhocOutput *output;
-  wl_list_for_each(output, &view->desktop->outputs, link)
-    phoc_output_damage_from_view (output, view, true);
+  view_damage (view, true);
 }
 
 
@@ -1430,6 +1694,7 @@ phoc_view_finalize (GObject *object)
     priv->fullscreen_output->fullscreen_view = NULL;
   }
 
+  g_clear_handle_id (&priv->frame_throttle_id, g_source_remove);
   g_clear_slist (&priv->blings, g_object_unref);
   g_clear_pointer (&priv->title, g_free);
   g_clear_pointer (&priv->app_id, g_free);
@@ -1617,6 +1882,24 @@ phoc_view_class_init (PhocViewClass *klass)
                   NULL, NULL, NULL,
                   G_TYPE_NONE,
                   0);
+
+  /**
+   * PhocView::content-damaged:
+   * @self: The view
+   * @damage: The damaged area in surface coordinates of the view's main surface
+   *
+   * Emitted when the view's surfaces committed new content regardless
+   * of whether the view is currently visible on any output.
+   */
+  signals[CONTENT_DAMAGED] =
+    g_signal_new ("content-damaged",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_POINTER);
 }
 
 
@@ -1864,6 +2147,49 @@ phoc_view_get_scale (PhocView *self)
   return priv->scale;
 }
 
+/**
+ * phoc_view_is_frame_throttled:
+ * @self: The view
+ *
+ * Whether the view currently gets frame callbacks at the reduced rate
+ * because it isn't visible or is occluded. This reflects the state as
+ * of the view's last commit or output frame.
+ *
+ * Returns: %TRUE if frame callbacks are throttled
+ */
+gboolean
+phoc_view_is_frame_throttled (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return priv->frame_throttled;
+}
+
+/**
+ * phoc_view_get_scale_path:
+ * @self: The view
+ *
+ * Get how the view's content gets scaled when it's scaled to fit. If
+ * the client supports fractional scaling it renders at the view's
+ * scale and its buffers are shown as is. Otherwise the compositor
+ * needs to scale the buffers when rendering.
+ *
+ * Returns: The scale path
+ */
+PhocViewScalePath
+phoc_view_get_scale_path (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return priv->scale_path;
+}
+
 /**
  * phoc_view_set_decorated
  * @self: The view
@@ -1959,6 +2285,105 @@ phoc_view_get_wlr_surface_at (PhocView *self, double sx, double sy, double *sub_
   return PHOC_VIEW_GET_CLASS (self)->get_wlr_surface_at (self, sx, sy, sub_x, sub_y);
 }
 
+
+static void
+input_bounds_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  struct wlr_box *bounds = data;
+  int x1, y1, x2, y2;
+
+  if (surface->current.width <= 0 || surface->current.height <= 0)
+    return;
+
+  if (wlr_box_empty (bounds)) {
+    *bounds = (struct wlr_box) { sx, sy, surface->current.width, surface->current.height };
+    return;
+  }
+
+  x1 = MIN (bounds->x, sx);
+  y1 = MIN (bounds->y, sy);
+  x2 = MAX (bounds->x + bounds->width, sx + surface->current.width);
+  y2 = MAX (bounds->y + bounds->height, sy + surface->current.height);
+  *bounds = (struct wlr_box) { x1, y1, x2 - x1, y2 - y1 };
+}
+
+/**
+ * phoc_view_invalidate_input_bounds:
+ * @self: The view
+ *
+ * Drop the cached bounding box of the view's surfaces. Damaging the
+ * view rebuilds it while collecting the damage so this is only needed
+ * when surfaces change without damaging the whole view.
+ */
+void
+phoc_view_invalidate_input_bounds (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  priv->input_bounds_valid = FALSE;
+}
+
+/**
+ * phoc_view_get_surface_bounds:
+ * @self: The view
+ * @bounds: (out): The bounding box
+ *
+ * Get the bounding box of all the view's surfaces, subsurfaces and
+ * popups relative to the view's main surface. The box is updated
+ * whenever the view gets damaged. Decorations aren't included.
+ */
+void
+phoc_view_get_surface_bounds (PhocView *self, struct wlr_box *bounds)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  if (!priv->input_bounds_valid) {
+    priv->input_bounds = (struct wlr_box) { 0 };
+    phoc_view_for_each_surface (self, input_bounds_iterator, &priv->input_bounds);
+    priv->input_bounds_valid = TRUE;
+  }
+
+  *bounds = priv->input_bounds;
+}
+
+/**
+ * phoc_view_may_have_surface_at:
+ * @self: The view
+ * @sx: x coordinate relative to the view's main surface
+ * @sy: y coordinate relative to the view's main surface
+ *
+ * Cheap check whether the view can have a surface or decoration at the
+ * given position. It compares against the cached bounding box of all
+ * the view's surfaces, subsurfaces and popups so hit testing can skip
+ * views without walking their surface trees.
+ *
+ * Returns: %FALSE if there's certainly nothing at the given position,
+ *  %TRUE if [method@View.get_wlr_surface_at] needs to be consulted.
+ */
+gboolean
+phoc_view_may_have_surface_at (PhocView *self, double sx, double sy)
+{
+  PhocViewPrivate *priv;
+  struct wlr_box bounds;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  /* Decorations extend beyond the surfaces */
+  if (priv->deco)
+    return TRUE;
+
+  phoc_view_get_surface_bounds (self, &bounds);
+
+  return wlr_box_contains_point (&bounds, sx, sy);
+}
+
 /*
  * phoc_view_want_automaximize:
  *
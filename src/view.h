@@ -38,6 +38,20 @@ typedef enum _PhocViewDecoPart {
   PHOC_VIEW_DECO_PART_TITLEBAR      = 1 << 4,
 } PhocViewDecoPart;
 
+/**
+ * PhocViewScalePath:
+ * @PHOC_VIEW_SCALE_PATH_NONE: The view isn't scaled
+ * @PHOC_VIEW_SCALE_PATH_CLIENT: The client renders at the view's scale
+ * @PHOC_VIEW_SCALE_PATH_COMPOSITOR: The compositor scales the client's buffers
+ *
+ * How a scaled-to-fit view gets scaled.
+ */
+typedef enum {
+  PHOC_VIEW_SCALE_PATH_NONE,
+  PHOC_VIEW_SCALE_PATH_CLIENT,
+  PHOC_VIEW_SCALE_PATH_COMPOSITOR,
+} PhocViewScalePath;
+
 typedef enum {
   PHOC_VIEW_CORNER_NORTH_WEST,
   PHOC_VIEW_CORNER_NORTH_EAST,
@@ -181,6 +195,8 @@ struct wlr_surface   *phoc_view_get_wlr_surface_at (PhocView *self,
                                                     double    sy,
                                                     double   *sub_x,
                                                     double   *sub_y);
+gboolean              phoc_view_may_have_surface_at (PhocView *self, double sx, double sy);
+void                  phoc_view_get_surface_bounds  (PhocView *self, struct wlr_box *bounds);
 PhocView             *phoc_view_from_wlr_surface (struct wlr_surface *wlr_surface);
 PhocOutput           *phoc_view_get_output (PhocView *view);
 
@@ -194,6 +210,8 @@ const char           *phoc_view_get_activation_token (PhocView *self);
 void                  phoc_view_flush_activation_token (PhocView *self);
 float                 phoc_view_get_alpha (PhocView *self);
 float                 phoc_view_get_scale (PhocView *self);
+PhocViewScalePath     phoc_view_get_scale_path (PhocView *self);
+gboolean              phoc_view_is_frame_throttled (PhocView *self);
 gboolean              phoc_view_is_decorated (PhocView *self);
 void                  phoc_view_set_always_on_top (PhocView *self, gboolean on_top);
 bool                  phoc_view_is_always_on_top (PhocView *self);
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "testlib-alloc.h"
+
+#include "cursor.h"
+#include "gesture-drag.h"
+#include "input-device.h"
+#include "seat.h"
+#include "settings.h"
+
+#define N_FINGERS       3
+#define N_WARMUP_CYCLES 10
+#define N_CYCLES        100
+#define N_MOTIONS       10
+#define N_FRAMES        20
+
+typedef struct {
+  struct wlr_touch  touch;
+  PhocInputDevice  *device;
+  guint32           time_msec;
+} PhocTestTouch;
+
+
+static PhocCursor *
+get_cursor (PhocServer *server)
+{
+  PhocInput *input = phoc_server_get_input (server);
+  PhocSeat *seat = phoc_input_get_seat (input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+  return phoc_seat_get_cursor (seat);
+}
+
+
+static void
+touch_setup (PhocServer *server, PhocTestTouch *touch)
+{
+  PhocInput *input = phoc_server_get_input (server);
+
+  *touch = (PhocTestTouch) { 0 };
+  wl_signal_init (&touch->touch.base.events.destroy);
+  touch->touch.base.type = WLR_INPUT_DEVICE_TOUCH;
+  touch->device = g_object_new (PHOC_TYPE_INPUT_DEVICE,
+                                "seat", phoc_input_get_seat (input, PHOC_CONFIG_DEFAULT_SEAT_NAME),
+                                "device", &touch->touch.base,
+                                NULL);
+}
+
+
+static void
+touch_teardown (PhocTestTouch *touch)
+{
+  wl_signal_emit_mutable (&touch->touch.base.events.destroy, &touch->touch.base);
+  g_clear_object (&touch->device);
+}
+
+/*
+ * Put several fingers down, move them around and lift them again. As
+ * there's no client surface under the fingers wlroots doesn't track
+ * any touch points so only phoc's own bookkeeping is exercised.
+ */
+static void
+touch_cycle (PhocCursor *cursor, PhocTestTouch *touch)
+{
+  for (int i = 0; i < N_FINGERS; i++) {
+    struct wlr_touch_down_event down = {
+      .touch = &touch->touch,
+      .time_msec = touch->time_msec,
+      .touch_id = i,
+      .x = 0.25 + i * 0.1,
+      .y = 0.5,
+    };
+    phoc_cursor_handle_touch_down (cursor, &down);
+  }
+  wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+
+  for (int j = 0; j < N_MOTIONS; j++) {
+    touch->time_msec += 4;
+    for (int i = 0; i < N_FINGERS; i++) {
+      struct wlr_touch_motion_event motion = {
+        .touch = &touch->touch,
+        .time_msec = touch->time_msec,
+        .touch_id = i,
+        .x = 0.25 + i * 0.1,
+        .y = 0.5 - j * 0.01,
+      };
+      phoc_cursor_handle_touch_motion (cursor, &motion);
+    }
+    wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+  }
+
+  for (int i = 0; i < N_FINGERS; i++) {
+    struct wlr_touch_up_event up = {
+      .touch = &touch->touch,
+      .time_msec = touch->time_msec,
+      .touch_id = i,
+    };
+    phoc_cursor_handle_touch_up (cursor, &up);
+  }
+  wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+}
+
+
+static gboolean
+touch_no_alloc_on_server (PhocServer *server, gpointer data)
+{
+  PhocCursor *cursor = get_cursor (server);
+  PhocTestTouch touch;
+  guint *n_allocs = data;
+
+  touch_setup (server, &touch);
+
+  /* Let the touch point tracking settle */
+  for (int i = 0; i < N_WARMUP_CYCLES; i++)
+    touch_cycle (cursor, &touch);
+
+  phoc_test_alloc_count_start ();
+  for (int i = 0; i < N_CYCLES; i++)
+    touch_cycle (cursor, &touch);
+  *n_allocs = phoc_test_alloc_count_stop ();
+
+  touch_teardown (&touch);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_touch_no_alloc (PhocTestClientGlobals *globals, gpointer data)
+{
+  guint n_allocs = G_MAXUINT;
+
+  g_assert_true (phoc_test_client_run_in_server (touch_no_alloc_on_server, &n_allocs));
+  g_assert_cmpuint (n_allocs, ==, 0);
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_cursor_touch_no_alloc (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_touch_no_alloc };
+
+  if (!phoc_test_alloc_count_supported ()) {
+    g_test_skip ("Can't count allocations on this platform");
+    return;
+  }
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static void
+on_drag_update (PhocGestureDrag *gesture, double off_x, double off_y, GArray *offsets)
+{
+  g_array_append_val (offsets, off_y);
+}
+
+
+static gboolean
+touch_samples_on_server (PhocServer *server, gpointer data)
+{
+  PhocCursor *cursor = get_cursor (server);
+  g_autoptr (PhocGestureDrag) drag = phoc_gesture_drag_new ();
+  GArray *offsets = data;
+  PhocTestTouch touch;
+  struct wlr_touch_down_event down;
+  struct wlr_touch_up_event up;
+  double y = 0.5;
+
+  g_signal_connect (drag, "drag-update", G_CALLBACK (on_drag_update), offsets);
+  phoc_cursor_add_gesture (cursor, PHOC_GESTURE (drag));
+
+  touch_setup (server, &touch);
+
+  down = (struct wlr_touch_down_event) {
+    .touch = &touch.touch, .time_msec = touch.time_msec, .x = 0.5, .y = y,
+  };
+  phoc_cursor_handle_touch_down (cursor, &down);
+  wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+
+  /* More motion events per frame than the touch point can buffer */
+  for (int i = 0; i < N_FRAMES; i++) {
+    for (int j = 0; j < N_MOTIONS; j++) {
+      struct wlr_touch_motion_event motion;
+
+      touch.time_msec += 1;
+      y -= 0.001;
+      motion = (struct wlr_touch_motion_event) {
+        .touch = &touch.touch, .time_msec = touch.time_msec, .x = 0.5, .y = y,
+      };
+      phoc_cursor_handle_touch_motion (cursor, &motion);
+    }
+    wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+  }
+
+  up = (struct wlr_touch_up_event) { .touch = &touch.touch, .time_msec = touch.time_msec };
+  phoc_cursor_handle_touch_up (cursor, &up);
+  wl_signal_emit_mutable (&cursor->cursor->events.touch_frame, NULL);
+
+  touch_teardown (&touch);
+  g_signal_handlers_disconnect_by_data (drag, offsets);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_touch_samples (PhocTestClientGlobals *globals, gpointer data)
+{
+  g_autoptr (GArray) offsets = g_array_new (FALSE, FALSE, sizeof (double));
+
+  g_assert_true (phoc_test_client_run_in_server (touch_samples_on_server, offsets));
+
+  /* Gestures get every sample in order */
+  g_assert_cmpint (offsets->len, ==, N_FRAMES * N_MOTIONS);
+  for (guint i = 1; i < offsets->len; i++)
+    g_assert_cmpfloat (g_array_index (offsets, double, i), <, g_array_index (offsets, double, i - 1));
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_cursor_touch_samples (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_touch_samples };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  PHOC_TEST_ADD ("/phoc/cursor/touch/no-alloc", test_phoc_cursor_touch_no_alloc);
+  PHOC_TEST_ADD ("/phoc/cursor/touch/samples", test_phoc_cursor_touch_samples);
+
+  return g_test_run ();
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "frame-timings.h"
+
+static void
+test_phoc_frame_timings_ring (void)
+{
+  g_autoptr (PhocFrameTimings) timings = phoc_frame_timings_new (3);
+  const PhocFrameTiming *timing;
+
+  g_assert_cmpuint (phoc_frame_timings_get_n_items (timings), ==, 0);
+
+  for (int i = 1; i <= 2; i++)
+    phoc_frame_timings_add (timings, &(PhocFrameTiming) { .frame_us = i });
+
+  g_assert_cmpuint (phoc_frame_timings_get_n_items (timings), ==, 2);
+  timing = phoc_frame_timings_get_item (timings, 0);
+  g_assert_cmpint (timing->frame_us, ==, 2);
+  timing = phoc_frame_timings_get_item (timings, 1);
+  g_assert_cmpint (timing->frame_us, ==, 1);
+
+  /* Oldest entries get replaced once full */
+  for (int i = 3; i <= 5; i++)
+    phoc_frame_timings_add (timings, &(PhocFrameTiming) { .frame_us = i, .n_draws = i });
+
+  g_assert_cmpuint (phoc_frame_timings_get_n_items (timings), ==, 3);
+  for (guint i = 0; i < 3; i++) {
+    timing = phoc_frame_timings_get_item (timings, i);
+    g_assert_cmpint (timing->frame_us, ==, 5 - i);
+    g_assert_cmpuint (timing->n_draws, ==, 5 - i);
+  }
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/frame-timings/ring", test_phoc_frame_timings_ring);
+
+  return g_test_run ();
+}
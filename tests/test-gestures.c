@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "event.h"
+#include "gesture-drag.h"
+#include "gesture-swipe.h"
+#include "input-device.h"
+
+#include "testlib-alloc.h"
+
+#define N_WARMUP_EVENTS 100
+#define N_EVENTS        1000
+
+
+static void
+feed_event (GPtrArray *gestures, PhocEventType type, gpointer wlr_event, gsize size,
+            double lx, double ly)
+{
+  PhocEvent event;
+
+  phoc_event_init (&event, type, wlr_event, size);
+  for (guint i = 0; i < gestures->len; i++)
+    phoc_gesture_handle_event (g_ptr_array_index (gestures, i), &event, lx, ly);
+}
+
+
+static void
+on_drag_update (PhocGestureDrag *gesture, double off_x, double off_y, guint *n_updates)
+{
+  (*n_updates)++;
+}
+
+
+static void
+test_phoc_gestures_no_alloc (void)
+{
+  g_autoptr (GPtrArray) gestures = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (PhocInputDevice) device = NULL;
+  struct wlr_touch touch = { 0 };
+  struct wlr_touch_down_event down;
+  struct wlr_touch_motion_event motion;
+  struct wlr_touch_up_event up;
+  PhocGestureDrag *drag;
+  guint n_updates = 0;
+  double y = 0.0;
+  guint32 time = 0;
+  guint n_allocs = 0;
+
+  if (!phoc_test_alloc_count_supported ()) {
+    g_test_skip ("Can't count allocations on this platform");
+    return;
+  }
+
+  wl_signal_init (&touch.base.events.destroy);
+  touch.base.type = WLR_INPUT_DEVICE_TOUCH;
+  device = g_object_new (PHOC_TYPE_INPUT_DEVICE, "device", &touch.base, NULL);
+
+  drag = phoc_gesture_drag_new ();
+  g_signal_connect (drag, "drag-update", G_CALLBACK (on_drag_update), &n_updates);
+  g_ptr_array_add (gestures, drag);
+  g_ptr_array_add (gestures, phoc_gesture_swipe_new ());
+
+  down = (struct wlr_touch_down_event) { .touch = &touch, .time_msec = time, .touch_id = 1 };
+  feed_event (gestures, PHOC_EVENT_TOUCH_BEGIN, &down, sizeof (down), 10.0, y);
+
+  /* Let gestures set up their state, e.g. the swipe's event backlog */
+  for (int i = 0; i < N_WARMUP_EVENTS + N_EVENTS; i++) {
+    if (i == N_WARMUP_EVENTS)
+      phoc_test_alloc_count_start ();
+
+    /* 240 Hz touch screen */
+    time += 4;
+    y += 1.0;
+    motion = (struct wlr_touch_motion_event) {
+      .touch = &touch, .time_msec = time, .touch_id = 1,
+    };
+    feed_event (gestures, PHOC_EVENT_TOUCH_UPDATE, &motion, sizeof (motion), 10.0, y);
+  }
+  n_allocs = phoc_test_alloc_count_stop ();
+
+  g_assert_cmpuint (n_allocs, ==, 0);
+  g_assert_cmpuint (n_updates, >=, N_EVENTS);
+
+  up = (struct wlr_touch_up_event) { .touch = &touch, .time_msec = time, .touch_id = 1 };
+  feed_event (gestures, PHOC_EVENT_TOUCH_END, &up, sizeof (up), 10.0, y);
+
+  wl_signal_emit_mutable (&touch.base.events.destroy, &touch.base);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/gestures/no-alloc", test_phoc_gestures_no_alloc);
+
+  return g_test_run ();
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#include "desktop.h"
+#include "output.h"
+
+#include <wayland-client-protocol.h>
+#include <wlr/types/wlr_output_layer.h>
+
+#define WIDTH 100
+#define HEIGHT 200
+
+typedef struct {
+  PhocOutput *output;
+  guint       planes;
+  guint       n_offloaded;
+} PhocTestOutputLayers;
+
+/* Emulate a backend with a given number of planes above the primary one */
+static gboolean
+fake_layers_test (PhocOutput *output, struct wlr_output_state *state, gpointer user_data)
+{
+  PhocTestOutputLayers *td = user_data;
+  guint used = 0;
+
+  for (int i = state->layers_len - 1; i >= 0; i--) {
+    struct wlr_output_layer_state *layer_state = &state->layers[i];
+
+    layer_state->accepted = FALSE;
+    if (layer_state->buffer == NULL)
+      continue;
+
+    if (used < td->planes) {
+      layer_state->accepted = TRUE;
+      used++;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static gboolean
+server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocTestOutputLayers *td = data;
+
+  td->output = wl_container_of (desktop->outputs.next, td->output, link);
+  g_assert_true (PHOC_IS_OUTPUT (td->output));
+
+  phoc_output_set_layers_test_func (td->output, fake_layers_test, td);
+  return TRUE;
+}
+
+
+static gboolean
+get_n_offloaded (PhocServer *server, gpointer data)
+{
+  PhocTestOutputLayers *td = data;
+
+  td->n_offloaded = phoc_output_get_n_offloaded (td->output);
+  return TRUE;
+}
+
+
+static guint
+get_n_offloaded_in_server (PhocTestOutputLayers *td)
+{
+  g_assert_true (phoc_test_client_run_in_server (get_n_offloaded, td));
+  return td->n_offloaded;
+}
+
+
+static gboolean
+raise_shield (PhocServer *server, gpointer data)
+{
+  PhocTestOutputLayers *td = data;
+
+  phoc_output_raise_shield (td->output);
+  return TRUE;
+}
+
+
+static void
+frame_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_done,
+};
+
+static void
+wait_for_frame (PhocTestClientGlobals *globals, PhocTestLayerSurface *ls)
+{
+  struct wl_callback *callback;
+  gboolean done = FALSE;
+
+  callback = wl_surface_frame (ls->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, &done);
+  wl_surface_damage (ls->wl_surface, 0, 0, ls->width, ls->height);
+  wl_surface_commit (ls->wl_surface);
+
+  while (!done)
+    g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+}
+
+
+static gboolean
+test_client_output_layers (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestOutputLayers *td = data;
+  PhocTestLayerSurface *ls_green, *ls_red;
+
+  ls_green = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00,
+                                          ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 0);
+  wait_for_frame (globals, ls_green);
+  g_assert_cmpint (get_n_offloaded_in_server (td), ==, MIN (td->planes, 1));
+
+  /* Only the front most surfaces go on planes, the rest is composited */
+  ls_red = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFFFF0000,
+                                        ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  wait_for_frame (globals, ls_red);
+  g_assert_cmpint (get_n_offloaded_in_server (td), ==, MIN (td->planes, 2));
+
+  /* The shield is drawn into the primary buffer so planes must not cover it */
+  g_assert_true (phoc_test_client_run_in_server (raise_shield, td));
+  wait_for_frame (globals, ls_green);
+  g_assert_cmpint (get_n_offloaded_in_server (td), ==, 0);
+
+  phoc_test_layer_surface_free (ls_red);
+  phoc_test_layer_surface_free (ls_green);
+
+  return TRUE;
+}
+
+
+static void
+run_output_layers (guint planes)
+{
+  PhocTestOutputLayers td = { .planes = planes };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare,
+    .client_run = test_client_output_layers,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &td);
+}
+
+
+static void
+test_output_layers_none (void)
+{
+  run_output_layers (0);
+}
+
+
+static void
+test_output_layers_one (void)
+{
+  run_output_layers (1);
+}
+
+
+static void
+test_output_layers_two (void)
+{
+  run_output_layers (2);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Plane support is faked on top of the headless backend */
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+
+  PHOC_TEST_ADD ("/phoc/output-layers/none", test_output_layers_none);
+  PHOC_TEST_ADD ("/phoc/output-layers/one", test_output_layers_one);
+  PHOC_TEST_ADD ("/phoc/output-layers/two", test_output_layers_two);
+
+  return g_test_run();
+}
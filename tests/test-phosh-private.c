@@ -5,6 +5,8 @@
  */
 
 #include "testlib.h"
+#include "desktop.h"
+#include "render-private.h"
 #include "gtk-shell-client-protocol.h"
 
 typedef struct _PhocTestThumbnail
@@ -48,11 +50,26 @@ phoc_test_thumbnail_free (PhocTestScreencopyFrame *frame)
   g_free (frame);
 }
 
+typedef struct _PhocTestPoolStats {
+  guint hits, misses;
+} PhocTestPoolStats;
+
+static gboolean
+get_pool_stats (PhocServer *server, gpointer data)
+{
+  PhocTestPoolStats *stats = data;
+
+  phoc_renderer_get_target_pool_stats (phoc_server_get_renderer (server),
+                                       &stats->hits, &stats->misses);
+  return TRUE;
+}
+
 static gboolean
 test_client_phosh_private_thumbnail_simple (PhocTestClientGlobals *globals, gpointer data)
 {
   PhocTestXdgToplevelSurface *toplevel_green;
   PhocTestScreencopyFrame *green_thumbnail;
+  PhocTestPoolStats stats;
 
   toplevel_green = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "green", 0xFF00FF00);
   g_assert_nonnull (toplevel_green);
@@ -62,6 +79,23 @@ test_client_phosh_private_thumbnail_simple (PhocTestClientGlobals *globals, gpoi
   phoc_assert_buffer_equal (&toplevel_green->buffer, &green_thumbnail->buffer);
   phoc_test_thumbnail_free (green_thumbnail);
 
+  /* Unchanged content is served from the cached thumbnail */
+  green_thumbnail = phoc_test_get_thumbnail (globals, toplevel_green->width, toplevel_green->height, toplevel_green->foreign_toplevel);
+  phoc_assert_buffer_equal (&toplevel_green->buffer, &green_thumbnail->buffer);
+  phoc_test_thumbnail_free (green_thumbnail);
+  g_assert_true (phoc_test_client_run_in_server (get_pool_stats, &stats));
+  g_assert_cmpint (stats.hits, ==, 0);
+  g_assert_cmpint (stats.misses, ==, 1);
+
+  /* New content gets rendered again */
+  phoc_test_xdg_update_buffer (globals, toplevel_green, 0xFFFF0000);
+  green_thumbnail = phoc_test_get_thumbnail (globals, toplevel_green->width, toplevel_green->height, toplevel_green->foreign_toplevel);
+  phoc_assert_buffer_equal (&toplevel_green->buffer, &green_thumbnail->buffer);
+  phoc_test_thumbnail_free (green_thumbnail);
+  g_assert_true (phoc_test_client_run_in_server (get_pool_stats, &stats));
+  g_assert_cmpint (stats.hits, ==, 1);
+  g_assert_cmpint (stats.misses, ==, 1);
+
   phoc_test_xdg_toplevel_free (toplevel_green);
   phoc_assert_screenshot (globals, "empty.png");
 
@@ -82,6 +116,64 @@ test_phosh_private_thumbnail_simple (void)
   phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, GINT_TO_POINTER (FALSE));
 }
 
+#define N_THUMBNAILS 50
+
+static gboolean
+get_thumbnail_stats (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  phoc_phosh_private_get_thumbnail_stats (phoc_desktop_get_phosh_private (desktop), data);
+  return TRUE;
+}
+
+static gboolean
+test_client_phosh_private_thumbnail_stall (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocPhoshPrivateThumbnailStats stats;
+  PhocTestXdgToplevelSurface *toplevel;
+
+  toplevel = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "stall", 0xFF00FF00);
+  g_assert_nonnull (toplevel);
+
+  for (int i = 0; i < N_THUMBNAILS; i++) {
+    PhocTestScreencopyFrame *thumbnail;
+
+    /* New content each time so every thumbnail gets rendered */
+    phoc_test_xdg_update_buffer (globals, toplevel, 0xFF000000 | g_random_int ());
+    thumbnail = phoc_test_get_thumbnail (globals, toplevel->width / 4, toplevel->height / 4,
+                                         toplevel->foreign_toplevel);
+    phoc_test_thumbnail_free (thumbnail);
+  }
+
+  g_assert_true (phoc_test_client_run_in_server (get_thumbnail_stats, &stats));
+  g_assert_cmpint (stats.n_frames, ==, N_THUMBNAILS);
+  g_test_maximized_result (stats.total_stall_us / (double)stats.n_frames / 1000.0,
+                           "Mean main loop stall per thumbnail: %.3f ms",
+                           stats.total_stall_us / (double)stats.n_frames / 1000.0);
+  g_test_message ("Max main loop stall per thumbnail: %.3f ms", stats.max_stall_us / 1000.0);
+
+  phoc_test_xdg_toplevel_free (toplevel);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_thumbnail_stall (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_thumbnail_stall,
+   .debug_flags = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  if (!g_test_perf ()) {
+    g_test_skip ("Benchmark, run with -m perf");
+    return;
+  }
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
 static void
 keyboard_event_handle_grab_failed (void *data,
                                    struct phosh_private_keyboard_event *kbevent,
@@ -299,6 +391,7 @@ main (gint argc, gchar *argv[])
   g_test_init (&argc, &argv, NULL);
 
   PHOC_TEST_ADD ("/phoc/phosh/thumbnail/simple", test_phosh_private_thumbnail_simple);
+  PHOC_TEST_ADD ("/phoc/phosh/thumbnail/stall", test_phosh_private_thumbnail_stall);
   PHOC_TEST_ADD ("/phoc/phosh/kbevents/simple", test_phosh_private_kbevents_simple);
   PHOC_TEST_ADD ("/phoc/phosh/startup-tracker/simple", test_phosh_private_startup_tracker_simple);
   return g_test_run ();
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "refresh-policy.h"
+
+#define LOW_MHZ     30000
+#define HIGH_HZ     60
+#define INTERVAL_US G_USEC_PER_SEC
+
+
+static PhocRefreshRate
+run_interval (PhocRefreshPolicy *policy, PhocRefreshRate current, guint n_frames, gint64 *now_us)
+{
+  for (guint i = 0; i < n_frames; i++)
+    phoc_refresh_policy_frame_done (policy);
+
+  *now_us += INTERVAL_US;
+  g_assert_true (phoc_refresh_policy_is_due (policy, *now_us));
+
+  return phoc_refresh_policy_evaluate (policy, current, FALSE, *now_us);
+}
+
+
+static void
+test_phoc_refresh_policy_static (void)
+{
+  gint64 now_us = G_USEC_PER_SEC;
+  g_autoptr (PhocRefreshPolicy) policy = phoc_refresh_policy_new (LOW_MHZ, now_us);
+
+  g_assert_false (phoc_refresh_policy_is_due (policy, now_us + INTERVAL_US / 2));
+
+  /* Content updating at the high rate */
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_HIGH, HIGH_HZ, &now_us),
+                   ==, PHOC_REFRESH_RATE_HIGH);
+
+  /* Static content and 30 fps video */
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_HIGH, 0, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_HIGH, 30, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+
+  /* Content slower than the low rate keeps it */
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_LOW, 10, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+}
+
+
+static void
+test_phoc_refresh_policy_busy (void)
+{
+  gint64 now_us = G_USEC_PER_SEC;
+  g_autoptr (PhocRefreshPolicy) policy = phoc_refresh_policy_new (LOW_MHZ, now_us);
+  PhocRefreshRate rate;
+
+  /* Input or animations */
+  phoc_refresh_policy_mark_busy (policy);
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_HIGH, 0, &now_us),
+                   ==, PHOC_REFRESH_RATE_HIGH);
+
+  /* Busy state doesn't carry over into the next interval */
+  g_assert_cmpint (run_interval (policy, PHOC_REFRESH_RATE_HIGH, 0, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+
+  /* Pending frame callbacks */
+  now_us += INTERVAL_US;
+  rate = phoc_refresh_policy_evaluate (policy, PHOC_REFRESH_RATE_LOW, TRUE, now_us);
+  g_assert_cmpint (rate, ==, PHOC_REFRESH_RATE_HIGH);
+}
+
+
+static PhocRefreshRate
+run_interval_with_updates (PhocRefreshPolicy *policy,
+                           PhocRefreshRate    current,
+                           guint              n_frames,
+                           guint              n_updates,
+                           gint64            *now_us)
+{
+  for (guint i = 0; i < n_updates; i++)
+    phoc_refresh_policy_content_update (policy);
+
+  return run_interval (policy, current, n_frames, now_us);
+}
+
+
+static void
+test_phoc_refresh_policy_video (void)
+{
+  gint64 now_us = G_USEC_PER_SEC;
+  g_autoptr (PhocRefreshPolicy) policy = phoc_refresh_policy_new (LOW_MHZ, now_us);
+
+  /* A 30 fps video switches to the low rate and stays there */
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_HIGH, 30, 30, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+  for (int i = 0; i < 20; i++) {
+    g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 30, &now_us),
+                     ==, PHOC_REFRESH_RATE_LOW);
+  }
+}
+
+
+static void
+test_phoc_refresh_policy_outpaced (void)
+{
+  gint64 now_us = G_USEC_PER_SEC;
+  g_autoptr (PhocRefreshPolicy) policy = phoc_refresh_policy_new (LOW_MHZ, now_us);
+
+  /* A single interval of faster updates isn't enough */
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 50, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 30, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+
+  /* Content updating faster than the low rate for several intervals */
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 50, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 50, &now_us),
+                   ==, PHOC_REFRESH_RATE_LOW);
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_LOW, 30, 50, &now_us),
+                   ==, PHOC_REFRESH_RATE_HIGH);
+
+  /* At the high rate the content shows its actual rate and keeps it there */
+  g_assert_cmpint (run_interval_with_updates (policy, PHOC_REFRESH_RATE_HIGH, 50, 50, &now_us),
+                   ==, PHOC_REFRESH_RATE_HIGH);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/refresh-policy/static", test_phoc_refresh_policy_static);
+  g_test_add_func ("/phoc/refresh-policy/busy", test_phoc_refresh_policy_busy);
+  g_test_add_func ("/phoc/refresh-policy/video", test_phoc_refresh_policy_video);
+  g_test_add_func ("/phoc/refresh-policy/outpaced", test_phoc_refresh_policy_outpaced);
+
+  return g_test_run ();
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "repaint-scheduler.h"
+
+#define PERIOD_US 16666
+
+
+#define FRAME_US  1000000
+
+
+static void
+test_phoc_repaint_scheduler_delay (void)
+{
+  g_autoptr (PhocRepaintScheduler) scheduler = phoc_repaint_scheduler_new ();
+  PhocRepaintSchedulerStats stats;
+  gint64 delay;
+
+  /* Unknown refresh rate or no history yet: repaint immediately */
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, 0), ==, 0);
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, PERIOD_US), ==, 0);
+
+  phoc_repaint_scheduler_frame_done (scheduler, 5000);
+  delay = phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, PERIOD_US);
+  g_assert_cmpint (delay, >, 0);
+  g_assert_cmpint (delay + 5000, <, PERIOD_US);
+
+  /* Slowest frame determines the prediction */
+  phoc_repaint_scheduler_frame_done (scheduler, 8000);
+  phoc_repaint_scheduler_frame_done (scheduler, 2000);
+  delay = phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, PERIOD_US);
+  g_assert_cmpint (delay + 8000, <, PERIOD_US);
+
+  phoc_repaint_scheduler_get_stats (scheduler, &stats);
+  g_assert_cmpuint (stats.n_frames, ==, 4);
+  g_assert_cmpuint (stats.n_delayed, ==, 2);
+  g_assert_cmpuint (stats.n_missed, ==, 0);
+  g_assert_cmpint (stats.predicted_us, ==, 8000);
+  g_assert_cmpint (stats.last_delay_us, ==, delay);
+}
+
+
+static void
+test_phoc_repaint_scheduler_bounds (void)
+{
+  g_autoptr (PhocRepaintScheduler) scheduler = phoc_repaint_scheduler_new ();
+
+  /* Cheap frames never get delayed by more than 3/4 of the period */
+  phoc_repaint_scheduler_frame_done (scheduler, 10);
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, PERIOD_US),
+                   ==, PERIOD_US * 3 / 4);
+
+  /* Expensive frames don't get delayed at all */
+  phoc_repaint_scheduler_frame_done (scheduler, PERIOD_US);
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, FRAME_US, PERIOD_US), ==, 0);
+}
+
+
+static void
+test_phoc_repaint_scheduler_presented (void)
+{
+  g_autoptr (PhocRepaintScheduler) scheduler = phoc_repaint_scheduler_new ();
+  PhocRepaintSchedulerStats stats;
+  gint64 frame_us = FRAME_US;
+
+  phoc_repaint_scheduler_frame_done (scheduler, 1000);
+
+  /* Presented on the next vblank: deadline made, jitter is fine */
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, frame_us, PERIOD_US), >, 0);
+  phoc_repaint_scheduler_presented (scheduler, frame_us + PERIOD_US + 500, PERIOD_US);
+
+  /* Presentation of undelayed frames isn't judged */
+  frame_us += PERIOD_US;
+  phoc_repaint_scheduler_presented (scheduler, frame_us + 4 * PERIOD_US, PERIOD_US);
+
+  phoc_repaint_scheduler_get_stats (scheduler, &stats);
+  g_assert_cmpuint (stats.n_delayed, ==, 1);
+  g_assert_cmpuint (stats.n_missed, ==, 0);
+}
+
+
+static void
+test_phoc_repaint_scheduler_fallback (void)
+{
+  g_autoptr (PhocRepaintScheduler) scheduler = phoc_repaint_scheduler_new ();
+  PhocRepaintSchedulerStats stats;
+  gint64 frame_us = FRAME_US;
+
+  phoc_repaint_scheduler_frame_done (scheduler, 1000);
+
+  /* Delayed frames that keep getting presented a vblank late */
+  for (int i = 0; i < 3; i++) {
+    g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, frame_us, PERIOD_US), >, 0);
+    phoc_repaint_scheduler_frame_done (scheduler, 1000);
+    phoc_repaint_scheduler_presented (scheduler, frame_us + 2 * PERIOD_US, PERIOD_US);
+    frame_us += 2 * PERIOD_US;
+  }
+
+  phoc_repaint_scheduler_get_stats (scheduler, &stats);
+  g_assert_cmpuint (stats.n_missed, ==, 3);
+  g_assert_cmpuint (stats.n_fallbacks, ==, 1);
+
+  /* Repaints happen immediately for a while */
+  g_assert_cmpint (phoc_repaint_scheduler_get_delay (scheduler, frame_us, PERIOD_US), ==, 0);
+  phoc_repaint_scheduler_get_stats (scheduler, &stats);
+  g_assert_cmpint (stats.last_delay_us, ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/repaint-scheduler/delay", test_phoc_repaint_scheduler_delay);
+  g_test_add_func ("/phoc/repaint-scheduler/bounds", test_phoc_repaint_scheduler_bounds);
+  g_test_add_func ("/phoc/repaint-scheduler/presented", test_phoc_repaint_scheduler_presented);
+  g_test_add_func ("/phoc/repaint-scheduler/fallback", test_phoc_repaint_scheduler_fallback);
+
+  return g_test_run ();
+}
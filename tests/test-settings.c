@@ -60,6 +60,32 @@ test_phoc_config_modelines (void)
 }
 
 
+static void
+test_phoc_config_refresh (void)
+{
+  PhocOutputConfig *oc;
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[output:X11-1]\n"
+    "adaptive-sync = true\n"
+    "low-refresh-rate = 30\n"
+    "[output:X11-2]\n"
+    "scale = 2\n");
+
+  g_assert_cmpint (g_slist_length (config->outputs), ==, 2);
+  for (GSList *l = config->outputs; l; l = l->next) {
+    oc = l->data;
+
+    if (g_str_equal (oc->name, "X11-1")) {
+      g_assert_true (oc->adaptive_sync);
+      g_assert_cmpfloat (oc->low_refresh_rate, ==, 30.0);
+    } else {
+      g_assert_false (oc->adaptive_sync);
+      g_assert_cmpfloat (oc->low_refresh_rate, ==, 0.0);
+    }
+  }
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -68,6 +94,7 @@ main (gint argc, gchar *argv[])
   g_test_add_func ("/phoc/config/simple", test_phoc_config_defaults);
   g_test_add_func ("/phoc/config/output", test_phoc_config_output);
   g_test_add_func ("/phoc/config/modelines", test_phoc_config_modelines);
+  g_test_add_func ("/phoc/config/refresh", test_phoc_config_refresh);
 
   return g_test_run();
 }
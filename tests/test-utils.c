@@ -44,12 +44,51 @@ test_phoc_utils_compute_scale (void)
   g_assert_cmpfloat (scale, ==, 1.0);
 }
 
+static void
+test_phoc_utils_get_opaque_region (void)
+{
+  pixman_region32_t opaque, out;
+  struct wlr_box box = { .x = 10, .y = 20, .width = 100, .height = 50 };
+  pixman_box32_t *extents;
+
+  pixman_region32_init_rect (&opaque, 0, 0, 100, 50);
+
+  /* Integer scales translate and scale exactly */
+  phoc_utils_get_opaque_region (&opaque, &box, 2.0, &out);
+  extents = pixman_region32_extents (&out);
+  g_assert_cmpint (extents->x1, ==, 20);
+  g_assert_cmpint (extents->y1, ==, 40);
+  g_assert_cmpint (extents->x2, ==, 220);
+  g_assert_cmpint (extents->y2, ==, 140);
+  pixman_region32_fini (&out);
+
+  /* Fractional scales never grow the opaque region */
+  box.x = 1;
+  box.y = 1;
+  phoc_utils_get_opaque_region (&opaque, &box, 1.5, &out);
+  extents = pixman_region32_extents (&out);
+  g_assert_cmpint (extents->x1, ==, 2);
+  g_assert_cmpint (extents->y1, ==, 2);
+  g_assert_cmpint (extents->x2, ==, 151);
+  g_assert_cmpint (extents->y2, ==, 76);
+  pixman_region32_fini (&out);
+
+  /* Empty opaque regions stay empty */
+  pixman_region32_clear (&opaque);
+  phoc_utils_get_opaque_region (&opaque, &box, 1.0, &out);
+  g_assert_false (pixman_region32_not_empty (&out));
+  pixman_region32_fini (&out);
+
+  pixman_region32_fini (&opaque);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/phoc/utils/compute_scale", test_phoc_utils_compute_scale);
+  g_test_add_func ("/phoc/utils/get_opaque_region", test_phoc_utils_get_opaque_region);
 
   return g_test_run ();
 }
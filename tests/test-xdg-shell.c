@@ -8,8 +8,34 @@
 
 #include "testlib.h"
 
+#include "desktop.h"
+#include "output.h"
+#include "view.h"
+
 #include "xdg-shell-client-protocol.h"
 
+#include <wlr/config.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
+#if WLR_HAS_X11_BACKEND
+# include <wlr/backend/x11.h>
+#endif
+
+/* Throttled views get frame callbacks at 1 Hz, allow for some slack */
+#define THROTTLED_MIN_INTERVAL_US (G_USEC_PER_SEC / 2)
+
+typedef struct {
+  gboolean top_throttled;
+  gboolean bottom_throttled;
+} PhocTestThrottleState;
+
+typedef struct {
+  struct wlr_output *lodpi;
+  struct wlr_output *hidpi;
+  struct wlr_output *target;
+  PhocViewScalePath  scale_path;
+} PhocTestScalePath;
+
 
 static gboolean
 test_client_xdg_shell_normal (PhocTestClientGlobals *globals, gpointer data)
@@ -72,6 +98,192 @@ test_client_xdg_shell_toplevel_maximized (PhocTestClientGlobals *globals, gpoint
 }
 
 
+static void
+frame_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gint64 *done_us = data;
+
+  *done_us = g_get_monotonic_time ();
+  wl_callback_destroy (callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_done,
+};
+
+/* Returns the time it took for the frame callback to arrive */
+static gint64
+update_buffer_and_wait_frame (PhocTestClientGlobals      *globals,
+                              PhocTestXdgToplevelSurface *xs,
+                              guint32                     color)
+{
+  struct wl_callback *callback;
+  gint64 start_us, done_us = 0;
+
+  callback = wl_surface_frame (xs->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, &done_us);
+  start_us = g_get_monotonic_time ();
+  phoc_test_xdg_update_buffer (globals, xs, color);
+
+  while (!done_us)
+    g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+
+  return done_us - start_us;
+}
+
+
+static gboolean
+get_throttle_state (PhocServer *server, gpointer data)
+{
+  GQueue *views = phoc_desktop_get_views (phoc_server_get_desktop (server));
+  PhocTestThrottleState *state = data;
+
+  g_assert_cmpint (g_queue_get_length (views), ==, 2);
+  /* Topmost view comes first */
+  state->top_throttled = phoc_view_is_frame_throttled (g_queue_peek_nth (views, 0));
+  state->bottom_throttled = phoc_view_is_frame_throttled (g_queue_peek_nth (views, 1));
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_xdg_shell_frame_throttle (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *bottom, *top;
+  PhocTestThrottleState state;
+  gint64 interval;
+
+  /* Both are maximized and opaque so top covers bottom completely */
+  bottom = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "bottom", 0xFF00FF00);
+  top = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "top", 0xFFFF0000);
+
+  interval = update_buffer_and_wait_frame (globals, bottom, 0xFF0000FF);
+  g_assert_cmpint (interval, >=, THROTTLED_MIN_INTERVAL_US);
+
+  interval = update_buffer_and_wait_frame (globals, top, 0xFFFFFF00);
+  g_assert_cmpint (interval, <, THROTTLED_MIN_INTERVAL_US);
+
+  g_assert_true (phoc_test_client_run_in_server (get_throttle_state, &state));
+  g_assert_true (state.bottom_throttled);
+  g_assert_false (state.top_throttled);
+
+  phoc_test_xdg_toplevel_free (top);
+  phoc_test_xdg_toplevel_free (bottom);
+
+  return TRUE;
+}
+
+
+static void
+add_output_iterator (struct wlr_backend *backend, void *data)
+{
+  struct wlr_output **wlr_output = data;
+
+  if (*wlr_output)
+    return;
+
+  if (wlr_backend_is_headless (backend))
+    *wlr_output = wlr_headless_add_output (backend, 1024, 768);
+#if WLR_HAS_X11_BACKEND
+  else if (wlr_backend_is_x11 (backend))
+    *wlr_output = wlr_x11_output_create (backend);
+#endif
+}
+
+
+static gboolean
+add_hidpi_output (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocTestScalePath *td = data;
+  struct wlr_output_state state;
+  PhocOutput *output;
+
+  output = wl_container_of (desktop->outputs.next, output, link);
+  td->lodpi = output->wlr_output;
+
+  wlr_multi_for_each_backend (phoc_server_get_backend (server), add_output_iterator, &td->hidpi);
+  g_assert_nonnull (td->hidpi);
+
+  /* Same logical size as the first output but twice the scale */
+  wlr_output_state_init (&state);
+  wlr_output_state_set_custom_mode (&state, 2048, 1536, 0);
+  wlr_output_state_set_scale (&state, 2.0);
+  g_assert_true (wlr_output_commit_state (td->hidpi, &state));
+  wlr_output_state_finish (&state);
+
+  return TRUE;
+}
+
+
+static gboolean
+move_view_to_output (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  GQueue *views = phoc_desktop_get_views (desktop);
+  PhocTestScalePath *td = data;
+  struct wlr_box box;
+  PhocView *view;
+
+  g_assert_cmpint (g_queue_get_length (views), ==, 1);
+  view = g_queue_peek_head (views);
+
+  wlr_output_layout_get_box (desktop->layout, td->target, &box);
+  phoc_view_move (view, box.x, box.y);
+  g_assert_true (phoc_view_get_output (view)->wlr_output == td->target);
+
+  td->scale_path = phoc_view_get_scale_path (view);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_xdg_shell_scale_path (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestScalePath td = { 0 };
+  PhocTestXdgToplevelSurface *xs;
+  guint32 color = 0xFF00FF00;
+
+  g_assert_true (phoc_test_client_run_in_server (add_hidpi_output, &td));
+
+  /* Twice the logical size of both outputs so scale-to-fit halves it */
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "scale-path", color);
+  xs->width = 2048;
+  xs->height = 1536;
+  phoc_test_xdg_update_buffer (globals, xs, color);
+
+  td.target = td.lodpi;
+  g_assert_true (phoc_test_client_run_in_server (move_view_to_output, &td));
+  g_assert_cmpint (td.scale_path, ==, PHOC_VIEW_SCALE_PATH_COMPOSITOR);
+
+  /* At scale 2 the buffer is shown 1:1 */
+  td.target = td.hidpi;
+  g_assert_true (phoc_test_client_run_in_server (move_view_to_output, &td));
+  g_assert_cmpint (td.scale_path, ==, PHOC_VIEW_SCALE_PATH_CLIENT);
+
+  td.target = td.lodpi;
+  g_assert_true (phoc_test_client_run_in_server (move_view_to_output, &td));
+  g_assert_cmpint (td.scale_path, ==, PHOC_VIEW_SCALE_PATH_COMPOSITOR);
+
+  phoc_test_xdg_toplevel_free (xs);
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_xdg_shell_scale_to_fit_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  phoc_desktop_set_auto_maximize (desktop, FALSE);
+  phoc_desktop_set_scale_to_fit (desktop, TRUE);
+  return TRUE;
+}
+
+
 static gboolean
 test_client_xdg_shell_server_prepare (PhocServer *server, gpointer data)
 {
@@ -121,6 +333,32 @@ test_xdg_shell_toplevel_maximized (void)
 }
 
 
+static void
+test_xdg_shell_frame_throttle (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_server_prepare,
+   .client_run     = test_client_xdg_shell_frame_throttle,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, GINT_TO_POINTER (TRUE));
+}
+
+
+static void
+test_xdg_shell_scale_path (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_scale_to_fit_server_prepare,
+   .client_run     = test_client_xdg_shell_scale_path,
+   .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -129,6 +367,8 @@ main (gint argc, gchar *argv[])
   PHOC_TEST_ADD ("/phoc/xdg-shell/simple", test_xdg_shell_normal);
   PHOC_TEST_ADD ("/phoc/xdg-shell/auto-maximize", test_xdg_shell_auto_maximized);
   PHOC_TEST_ADD ("/phoc/xdg-shell/toplevel-maximize", test_xdg_shell_toplevel_maximized);
+  PHOC_TEST_ADD ("/phoc/xdg-shell/frame-throttle", test_xdg_shell_frame_throttle);
+  PHOC_TEST_ADD ("/phoc/xdg-shell/scale-path", test_xdg_shell_scale_path);
 
   return g_test_run();
 }
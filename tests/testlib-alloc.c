@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib-alloc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Count heap allocations by interposing the allocator. Only possible
+ * with glibc and not when running under a sanitizer.
+ */
+#if defined (__SANITIZE_ADDRESS__)
+# define HAVE_ASAN 1
+#elif defined (__has_feature)
+# if __has_feature (address_sanitizer)
+#  define HAVE_ASAN 1
+# endif
+#endif
+
+static pthread_t count_thread;
+static gint count_allocs;
+static guint n_allocs;
+
+#if defined (__GLIBC__) && !defined (HAVE_ASAN)
+# define COUNT_ALLOCS 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static inline void
+count_alloc (void)
+{
+  if (g_atomic_int_get (&count_allocs) && pthread_equal (pthread_self (), count_thread))
+    n_allocs++;
+}
+
+void *
+malloc (size_t size)
+{
+  count_alloc ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  count_alloc ();
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  count_alloc ();
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+/**
+ * phoc_test_alloc_count_supported:
+ *
+ * Whether heap allocations can be counted on this platform.
+ *
+ * Returns: %TRUE if allocations are counted
+ */
+gboolean
+phoc_test_alloc_count_supported (void)
+{
+#ifdef COUNT_ALLOCS
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * phoc_test_alloc_count_start:
+ *
+ * Start counting heap allocations. Only allocations made by the
+ * calling thread are counted so e.g. a test client running in another
+ * thread doesn't interfere.
+ */
+void
+phoc_test_alloc_count_start (void)
+{
+  count_thread = pthread_self ();
+  n_allocs = 0;
+  g_atomic_int_set (&count_allocs, TRUE);
+}
+
+/**
+ * phoc_test_alloc_count_stop:
+ *
+ * Stop counting heap allocations. Must be called from the thread
+ * that started counting.
+ *
+ * Returns: The number of allocations since
+ *   [func@phoc_test_alloc_count_start] was called. Always 0 if counting
+ *   isn't supported.
+ */
+guint
+phoc_test_alloc_count_stop (void)
+{
+  g_assert_true (pthread_equal (pthread_self (), count_thread));
+  g_atomic_int_set (&count_allocs, FALSE);
+
+  return n_allocs;
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean phoc_test_alloc_count_supported (void);
+void     phoc_test_alloc_count_start     (void);
+guint    phoc_test_alloc_count_stop      (void);
+
+G_END_DECLS
@@ -301,8 +301,9 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
     globals->shm = wl_registry_bind (registry, name, &wl_shm_interface, 1);
     wl_shm_add_listener (globals->shm, &shm_listener, globals);
   } else if (!g_strcmp0 (interface, wl_output_interface.name)) {
-    /* TODO: only one output atm */
-    g_assert_null (globals->output.output);
+    /* TODO: only one output atm, ignore outputs added by tests */
+    if (globals->output.output)
+      return;
     globals->output.output = wl_registry_bind (registry, name,
                                                &wl_output_interface, 3);
     wl_output_add_listener(globals->output.output, &output_listener, &globals->output);
@@ -453,6 +454,65 @@ phoc_test_client_run (gint timeout, PhocTestClientIface *iface, gpointer data)
   g_main_loop_run (loop);
 }
 
+typedef struct {
+  PhocTestServerFunc func;
+  gpointer           data;
+  gboolean           success;
+  gboolean           done;
+  GMutex             mutex;
+  GCond              cond;
+} PhocTestServerCall;
+
+
+static gboolean
+on_server_call (gpointer user_data)
+{
+  PhocTestServerCall *call = user_data;
+  gboolean success;
+
+  success = call->func (phoc_server_get_default (), call->data);
+
+  g_mutex_lock (&call->mutex);
+  call->success = success;
+  call->done = TRUE;
+  g_cond_signal (&call->cond);
+  g_mutex_unlock (&call->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_test_client_run_in_server:
+ * @func: The function to run
+ * @data: Data passed to the function
+ *
+ * Run @func in the compositor's main loop and wait for it to finish.
+ * Use this from the test client to look at compositor state without
+ * racing the compositor.
+ *
+ * Returns: The return value of @func
+ */
+gboolean
+phoc_test_client_run_in_server (PhocTestServerFunc func, gpointer data)
+{
+  PhocTestServerCall call = { .func = func, .data = data };
+
+  g_mutex_init (&call.mutex);
+  g_cond_init (&call.cond);
+
+  g_main_context_invoke (NULL, on_server_call, &call);
+
+  g_mutex_lock (&call.mutex);
+  while (!call.done)
+    g_cond_wait (&call.cond, &call.mutex);
+  g_mutex_unlock (&call.mutex);
+
+  g_cond_clear (&call.cond);
+  g_mutex_clear (&call.mutex);
+
+  return call.success;
+}
+
 static int
 create_anon_file (off_t size)
 {
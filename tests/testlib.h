@@ -100,6 +100,7 @@ typedef struct _PhocTestFixture {
 
 /* Test client */
 void phoc_test_client_run (gint timeout, PhocTestClientIface *iface, gpointer data);
+gboolean phoc_test_client_run_in_server (PhocTestServerFunc func, gpointer data);
 int  phoc_test_client_create_shm_buffer (PhocTestClientGlobals *globals,
                                          PhocTestBuffer *buffer,
                                          int width, int height, guint32 format);